@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /* --- type definitions --------------------------------------------------- */
 
@@ -94,6 +95,8 @@ ValType return_type; /**< the return type of the current subroutine          */
 
 #define IS_TYPE(toktype)  (toktype = TOK_BOOL || toktype == TOK_INT)
 
+#define USAGE "usage: %s [-bcimops] [-j threads] [-n budget] <filename>"
+
 /* --- function prototypes: parser routines -------------------------------- */
 
 void parse_program(void);
@@ -164,15 +167,62 @@ int main(int argc, char *argv[])
 	char *jasmin_path;
 #endif
 	FILE *src_file;
+	bool show_stats;
+	unsigned int options;
+	int opt, nthreads, budget;
+	char *end;
 
 	/* TODO: Uncomment the previous definition for code generation. */
 
 	/* set up global variables */
 	setprogname(argv[0]);
+	show_stats = false;
+	options = 0;
+	nthreads = 1;
+	budget = -1;
 
 	/* check command-line arguments and environment */
-	if (argc != 2) {
-		eprintf("usage: %s <filename>", getprogname());
+	while ((opt = getopt(argc, argv, "bcij:mn:ops")) != -1) {
+		switch (opt) {
+			case 'b':
+				options |= OPT_STREAM;
+				break;
+			case 'c':
+				options |= OPT_CACHE_STREAM;
+				break;
+			case 'i':
+				options |= OPT_FAST_INPUT;
+				break;
+			case 'j':
+				nthreads = (int) strtol(optarg, &end, 10);
+				if (*end != '\0' || nthreads < 1) {
+					eprintf(USAGE, getprogname());
+				}
+				break;
+			case 'm':
+				options |= OPT_MEMOISE;
+				break;
+			case 'n':
+				budget = (int) strtol(optarg, &end, 10);
+				if (*end != '\0' || budget < 0) {
+					eprintf(USAGE, getprogname());
+				}
+				break;
+			case 'o':
+				options |= OPT_FAST_OUTPUT;
+				break;
+			case 'p':
+				options |= OPT_PACK_LOCALS;
+				break;
+			case 's':
+				show_stats = true;
+				break;
+			default:
+				eprintf(USAGE, getprogname());
+		}
+	}
+	if (optind != argc - 1) {
+		eprintf(USAGE, getprogname());
 	}
 
 	/* TODO: Uncomment the following code for code generation: */
@@ -181,16 +231,21 @@ int main(int argc, char *argv[])
 	}
 
 	/* open the source file, and report an error if it cannot be opened */
-	if ((src_file = fopen(argv[1], "r")) == NULL) {
-		eprintf("file '%s' could not be opened:", argv[1]);
+	if ((src_file = fopen(argv[optind], "r")) == NULL) {
+		eprintf("file '%s' could not be opened:", argv[optind]);
 	}
 
-	setsrcname(argv[1]);
+	setsrcname(argv[optind]);
 
 	/* initialise all compiler units */
 	init_scanner(src_file);
 	init_symbol_table();
 	init_code_generation();
+	set_codegen_options(options);
+	set_dump_threads(nthreads);
+	if (budget >= 0) {
+		set_inline_budget(budget);
+	}
 
 	/* compile */
 	get_token(&token);
@@ -204,6 +259,10 @@ int main(int argc, char *argv[])
 	list_code();
 #endif
 
+	if (show_stats) {
+		list_statistics();
+	}
+
 	/* release all allocated resources */
 	fclose(src_file);
 	freeprogname();
@@ -283,7 +342,7 @@ void parse_subdef(void)
 	ValType t1, *params;
 	Variable *head, *temp, *newvar;
 	unsigned int count, i, width;
-	IDPropt *prop;
+	IDPropt *prop, *subprop;
 
 	subpos = position;
 	count = 0;
@@ -331,9 +390,10 @@ void parse_subdef(void)
 	}
 	return_type = t1;
 	width = get_variables_width();
-	prop = idpropt(t1, width, count, params);
+	subprop = idpropt(t1, width, count, params);
 
-	if (open_subroutine(subid, prop)) {
+	/* the parameters take the slots from 0 in order, as the JVM passes them */
+	if (open_subroutine(subid, subprop)) {
 		while (head != NULL) {
 			temp = head;
 			prop = NULL;
@@ -353,7 +413,7 @@ void parse_subdef(void)
 			temp = NULL;
 		}
 		expect(TOK_COLON);
-		init_subroutine_codegen(subid, prop);
+		init_subroutine_codegen(subid, subprop);
 		parse_body();
 		close_subroutine_codegen(get_variables_width());
 		close_subroutine();
@@ -569,7 +629,7 @@ void parse_assign(void)
 		parse_expr(&t1);
 
 		if (indexed) {
-			gen_1(JVM_IASTORE);
+			gen_1(IS_BOOLEAN_TYPE(prop->type) ? JVM_BASTORE : JVM_IASTORE);
 		} else {
 			if (IS_ARRAY(prop->type)) {
 				gen_2(JVM_ASTORE, prop->offset);
@@ -591,12 +651,14 @@ void parse_assign(void)
 		pos = position;
 		parse_simple(&t1);
 		chktypes(t1, TYPE_INTEGER, &pos, "for array size of '%s'", id);
-		gen_newarray(T_INT);
+		gen_newarray(IS_BOOLEAN_TYPE(prop->type) ? T_BOOLEAN : T_INT);
 		gen_2(JVM_ASTORE, prop->offset);
 	} else {
 		abort_c(ERR_EXPECTED_EXPRESSION_OR_ARRAY_ALLOCATION);
 	}
 
+	free(id);
+
 	DBG_end("</assign>");
 }
 
@@ -637,6 +699,7 @@ void parse_call(void)
 
 	parse_arglist(id, idpos);
 	gen_call(id, prop);
+	free(id);
 
 	DBG_end("</call>");
 }
@@ -649,14 +712,12 @@ void parse_if(void)
 {
 	ValType t1;
 	SourcePos pos;
-	bool elif;
-	int label_1, label_2, label_3;
+	int label_1, label_2;
 
 	DBG_start("<if>");
 
 	label_1 = get_label();
 	label_2 = get_label();
-	elif = false;
 
 	expect(TOK_IF);
 	pos = position;
@@ -668,38 +729,27 @@ void parse_if(void)
 	gen_2_label(JVM_GOTO, label_1);
 
 	while (token.type == TOK_ELIF) {
-		elif = true;
-		label_3 = label_2 + 1;
 		gen_label(label_2);
+		/* a fresh label, since the guards take labels of their own */
+		label_2 = get_label();
 		get_token(&token);
 		pos = position;
 		parse_expr(&t1);
-		gen_2_label(JVM_IFEQ, label_3);
+		gen_2_label(JVM_IFEQ, label_2);
 		chktypes(t1, TYPE_BOOLEAN, &pos, "for 'elif' guard");
 		expect(TOK_COLON);
 		parse_statements();
 		gen_2_label(JVM_GOTO, label_1);
-		label_2 = get_label();
-	}
-
-	if (elif) {
-		label_3 = label_2;
-	}
-
-	if (token.type != TOK_ELSE) {
-		label_3 = label_2;
 	}
 
+	gen_label(label_2);
 	if (token.type == TOK_ELSE) {
 		DBG_start("<else>");
 		get_token(&token);
 		expect(TOK_COLON);
-		gen_label(label_3);
 		parse_statements();
 
 		DBG_end("</else>");
-	} else {
-		gen_label(label_3);
 	}
 
 	gen_label(label_1);
@@ -748,12 +798,13 @@ void parse_input(void)
 	}
 
 	if (IS_ARRAY_TYPE(prop->type)) {
-		gen_1(JVM_IASTORE);
+		gen_1(IS_BOOLEAN_TYPE(prop->type) ? JVM_BASTORE : JVM_IASTORE);
 	} else {
 		gen_2(JVM_ISTORE, prop->offset);
 	}
 
 	expect(TOK_RPAREN);
+	free(id);
 
 	DBG_end("</input>");
 }
@@ -771,6 +822,7 @@ void parse_output(void)
 	pos = position;
 	expect(TOK_OUTPUT);
 	expect(TOK_LPAREN);
+	gen_print_begin();
 
 	if (token.type == TOK_STR) {
 		gen_print_string(token.string);
@@ -804,6 +856,7 @@ void parse_output(void)
 		}
 	}
 
+	gen_print_end();
 	expect(TOK_RPAREN);
 
 	DBG_end("</output>");
@@ -1227,7 +1280,7 @@ void parse_factor(ValType *t0)
 				*t0 = prop->type & 6;
 				gen_2(JVM_ALOAD, prop->offset);
 				parse_index(id);
-				gen_1(JVM_IALOAD);
+				gen_1(IS_BOOLEAN_TYPE(prop->type) ? JVM_BALOAD : JVM_IALOAD);
 			} else if (token.type == TOK_LPAREN) {
 				if (!IS_FUNCTION(prop->type)) {
 					position = pos;
@@ -1282,6 +1335,8 @@ void parse_factor(ValType *t0)
 			abort_c(ERR_EXPECTED_FACTOR);
 	}
 
+	free(id);
+
 	DBG_end("</factor>");
 }
 
@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Times read_ints.ampl on 10^7 integers, compiled once with the Scanner input
+# runtime and once with the buffered input runtime of 'amplc -i', and checks
+# that both print the same sum.
+#
+# usage: bench/bench_input.sh [n]
+#
+# AMPLC names the compiler, by default ./amplc in the root of the repository,
+# and JASMIN_JAR the Jasmin assembler, as for amplc itself.
+
+BENCH=$(cd "$(dirname "$0")" && pwd)
+AMPLC=${AMPLC:-$(dirname "$BENCH")/amplc}
+N=${1:-10000000}
+TIMEFORMAT="%R s"
+
+if [ -z "$JASMIN_JAR" ]; then
+	echo "$0: JASMIN_JAR environment variable not set" >&2
+	exit 1
+fi
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+echo "generating $N integers"
+"$BENCH/gen_ints.sh" "$N" > ints.txt
+
+for flags in "" "-i"; do
+	"$AMPLC" $flags "$BENCH/read_ints.ampl" || exit 1
+	echo "amplc ${flags:-(Scanner)}:"
+	time java -cp . ReadInts < ints.txt > "sum${flags}.txt" || exit 1
+	cat "sum${flags}.txt"
+done
+
+if ! cmp -s sum.txt sum-i.txt; then
+	echo "$0: the two input runtimes disagree" >&2
+	exit 1
+fi
@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# Writes the input of read_ints.ampl to standard output: the count n on the
+# first line, followed by n pseudo-random integers, one per line, between
+# -10^9 and 10^9.  The seed is fixed, so that every run reads the same input.
+#
+# usage: bench/gen_ints.sh [n]
+
+awk -v n="${1:-10000000}" 'BEGIN {
+	srand(1)
+	print n
+	for (i = 0; i < n; i++) {
+		printf "%d\n", int(rand() * 2000000001) - 1000000000
+	}
+}'
@@ -10,13 +10,19 @@
 
 #include "boolean.h"
 #include "error.h"
+#include "hashtable.h"
 #include "valtypes.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -42,40 +48,128 @@ typedef struct {
 	short push;
 } BC;
 
+/* A code element is eight bytes: string and reference operands are kept in
+ * the string table, and the element only holds their index.
+ */
 typedef struct {
-	CodeType type;
+	unsigned short type;
 	union {
 		JVMatype atype;
 		Bytecode code;
 		Label label;
 		int num;
-		char *string;
+		unsigned int str;
 	};
 } Code;
 
+typedef struct {
+	int dead_code;      /**< unreachable instructions removed              */
+	int labels_merged;  /**< adjacent labels coalesced into one            */
+	int jumps_threaded; /**< branches retargeted past an unconditional goto */
+	int jumps_removed;  /**< jumps to the immediately following instruction */
+	int slots_saved;    /**< local variable slots saved by packing         */
+	int folded;         /**< operations evaluated at compile time          */
+	int prints_saved;   /**< output calls saved by coalescing pieces       */
+	int increments;     /**< assignments turned into iinc                  */
+	int reloads_saved;  /**< array operands reused through dup2          */
+	int muls_reduced;   /**< multiplications turned into shifts            */
+	int divs_reduced;   /**< divisions turned into shifts                  */
+	int rems_reduced;   /**< remainders turned into masks                  */
+	int branches_fused; /**< comparisons fused with the branch on them     */
+	int switches;       /**< if chains turned into switches                */
+	int inlined;        /**< calls replaced by the body of the callee      */
+	int tail_calls;     /**< self-calls in tail position turned into jumps */
+	int pure;           /**< subroutines without side effects              */
+	int memoised;       /**< pure functions wrapped with a memo table      */
+	int evaluated;      /**< calls evaluated at compile time               */
+	int dead_methods;   /**< subroutines unreachable from main             */
+} Stats;
+
+typedef struct {
+	ValType type; /**< the type of a computed piece, or TYPE_NONE for text */
+	int start;    /**< the start of the code, or of the text               */
+	int end;      /**< the end of the code, or of the text                 */
+} Piece;
+
+typedef struct {
+	unsigned long weight; /**< loop-weighted number of accesses */
+	int slot;             /**< the local variable slot          */
+} SlotUse;
+
+typedef struct {
+	int key;     /**< the constant compared with             */
+	int test;    /**< the index of the test in the code      */
+	Label label; /**< the label of the case, 0 for a repeat   */
+} SwitchCase;
+
+typedef struct {
+	char *data;  /**< the buffered characters              */
+	size_t len;  /**< the number of characters in use      */
+	size_t size; /**< the number of characters allocated   */
+} Buffer;
+
+typedef struct arena_block_s ArenaBlock;
+struct arena_block_s {
+	ArenaBlock *next;   /**< the previously filled block                */
+	size_t used;        /**< the number of bytes handed out             */
+	size_t size;        /**< the number of bytes available in the block */
+	max_align_t data[]; /**< the memory of the block                    */
+};
+
 typedef struct body_s Body;
+
+typedef struct {
+	Body **methods;       /**< the bodies to serialise, in output order */
+	Buffer *bufs;         /**< one output buffer per body               */
+	int n;                /**< the number of bodies                     */
+	int next;             /**< the index of the next body to serialise  */
+	pthread_mutex_t lock; /**< guards <code>next</code>                 */
+} DumpJob;
 struct body_s {
 	char *name;
 	IDPropt *idprop;
+	unsigned int desc;
 	Code *code;
 	int ip;
 	int max_stack_depth;
 	int variables_width;
+	int bytes_saved;
+	int memo;
+	Body **callees;
+	int ncallees;
+	int fan_in;
+	int reachable;
 	Body *next;
 	Body *prev;
 };
 
 /* --- Jasmin output string literals ---------------------------------------- */
 
-char class_preamble[] =
+/* The preamble is assembled from the following pieces, depending on which
+ * runtime support the options select.
+ */
+char class_header[] =
 ".class public %s\n"
-".super java/lang/Object\n\n"
+".super java/lang/Object\n";
+
+char class_runnable[] =
+".implements java/lang/Runnable\n";
+
+char fields_scanner[] =
 ".field private static final charsetName Ljava/lang/String;\n"
 ".field private static final usLocale Ljava/util/Locale;\n"
-".field private static final scanner Ljava/util/Scanner;\n\n"
+".field private static final scanner Ljava/util/Scanner;\n";
+
+char clinit_begin[] =
 ".method static public <clinit>()V\n"
 ".limit stack 5\n"
-".limit locals 1 \n"
+".limit locals 1 \n";
+
+char clinit_end[] =
+"\treturn\n"
+".end method\n\n";
+
+char clinit_scanner[] =
 "\tldc	\"UTF-8\"\n"
 "\tputstatic %s/charsetName Ljava/lang/String;\n"
 "\tnew	java/util/Locale\n"
@@ -100,9 +194,7 @@ char class_preamble[] =
 "\tgetstatic %s/usLocale Ljava/util/Locale;\n"
 "\tinvokevirtual"
 " java/util/Scanner/useLocale(Ljava/util/Locale;)Ljava/util/Scanner;\n"
-"\tpop\n"
-"\treturn\n"
-".end method\n\n";
+"\tpop\n";
 
 char method_init[] = ".method public <init>()V\n"
 "\taload_0\n"
@@ -145,51 +237,538 @@ char method_readInt[] = ".method public static readInt()I\n"
 "\tireturn\n"
 ".end method\n\n";
 
+/* The fast input runtime reads standard input through a byte buffer of its
+ * own, and parses integer and boolean tokens by hand instead of through the
+ * regular expressions of java.util.Scanner.
+ */
+char fields_fast_input[] =
+".field private static final inbuf [B\n"
+".field private static inpos I\n"
+".field private static inlen I\n";
+
+char clinit_fast_input[] =
+"\tldc 65536\n"
+"\tnewarray byte\n"
+"\tputstatic %s/inbuf [B\n";
+
+char method_readByte[] =
+".method private static readByte()I\n"
+".limit stack 4\n"
+".limit locals 0\n"
+"\tgetstatic %s/inpos I\n"
+"\tgetstatic %s/inlen I\n"
+"\tif_icmplt Ready\n"
+"\tgetstatic java/lang/System/in Ljava/io/InputStream;\n"
+"\tgetstatic %s/inbuf [B\n"
+"\tinvokevirtual java/io/InputStream/read([B)I\n"
+"\tdup\n"
+"\tputstatic %s/inlen I\n"
+"\tifgt Refill\n"
+"\ticonst_m1\n"
+"\tireturn\n"
+"Refill:\n"
+"\ticonst_0\n"
+"\tputstatic %s/inpos I\n"
+"Ready:\n"
+"\tgetstatic %s/inbuf [B\n"
+"\tgetstatic %s/inpos I\n"
+"\tdup\n"
+"\ticonst_1\n"
+"\tiadd\n"
+"\tputstatic %s/inpos I\n"
+"\tbaload\n"
+"\tsipush 255\n"
+"\tiand\n"
+"\tireturn\n"
+".end method\n\n";
+
+char method_readInt_fast[] =
+".method public static readInt()I\n"
+".limit stack 2\n"
+".limit locals 3\n"
+"Skip:\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tistore_0\n"
+"\tiload_0\n"
+"\tifge Token\n"
+"\tnew java/util/NoSuchElementException\n"
+"\tdup\n"
+"\tinvokespecial java/util/NoSuchElementException/<init>()V\n"
+"\tathrow\n"
+"Token:\n"
+"\tiload_0\n"
+"\tbipush 32\n"
+"\tif_icmple Skip\n"
+"\ticonst_0\n"
+"\tistore_1\n"
+"\tiload_0\n"
+"\tbipush 43\n"
+"\tif_icmpeq Sign\n"
+"\tiload_0\n"
+"\tbipush 45\n"
+"\tif_icmpne First\n"
+"\ticonst_1\n"
+"\tistore_1\n"
+"Sign:\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tistore_0\n"
+"First:\n"
+"\tiload_0\n"
+"\tbipush 48\n"
+"\tif_icmplt Exception\n"
+"\tiload_0\n"
+"\tbipush 57\n"
+"\tif_icmpgt Exception\n"
+"\ticonst_0\n"
+"\tistore_2\n"
+"Digit:\n"
+"\tiload_2\n"
+"\tldc -214748364\n"
+"\tif_icmplt Exception\n"
+"\tiload_2\n"
+"\tbipush 10\n"
+"\timul\n"
+"\tbipush 48\n"
+"\tiadd\n"
+"\tiload_0\n"
+"\tisub\n"
+"\tistore_2\n"
+"\tiload_2\n"
+"\tifgt Exception\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tistore_0\n"
+"\tiload_0\n"
+"\tbipush 48\n"
+"\tif_icmplt End\n"
+"\tiload_0\n"
+"\tbipush 57\n"
+"\tif_icmple Digit\n"
+"End:\n"
+"\tiload_0\n"
+"\tbipush 32\n"
+"\tif_icmpgt Exception\n"
+"\tiload_1\n"
+"\tifeq Positive\n"
+"\tiload_2\n"
+"\tireturn\n"
+"Positive:\n"
+"\tiload_2\n"
+"\tldc -2147483648\n"
+"\tif_icmpeq Exception\n"
+"\tiload_2\n"
+"\tineg\n"
+"\tireturn\n"
+"Exception:\n"
+"\tnew	java/util/InputMismatchException\n"
+"\tdup\n"
+"\tinvokespecial java/util/InputMismatchException/<init>()V\n"
+"\tathrow\n"
+".end method\n\n";
+
+char method_readBoolean_fast[] =
+".method public static readBoolean()Z\n"
+".limit stack 2\n"
+".limit locals 1\n"
+"Skip:\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tistore_0\n"
+"\tiload_0\n"
+"\tifge Token\n"
+"\tnew java/util/NoSuchElementException\n"
+"\tdup\n"
+"\tinvokespecial java/util/NoSuchElementException/<init>()V\n"
+"\tathrow\n"
+"Token:\n"
+"\tiload_0\n"
+"\tbipush 32\n"
+"\tif_icmple Skip\n"
+"\tiload_0\n"
+"\tbipush 32\n"
+"\tior\n"
+"\tistore_0\n"
+"\tiload_0\n"
+"\tbipush 116\n"
+"\tif_icmpne False\n"
+"\tldc	\"rue\"\n"
+"\tinvokestatic %s/matchRest(Ljava/lang/String;)V\n"
+"\ticonst_1\n"
+"\tireturn\n"
+"False:\n"
+"\tiload_0\n"
+"\tbipush 102\n"
+"\tif_icmpne Exception\n"
+"\tldc	\"alse\"\n"
+"\tinvokestatic %s/matchRest(Ljava/lang/String;)V\n"
+"\ticonst_0\n"
+"\tireturn\n"
+"Exception:\n"
+"\tnew	java/util/InputMismatchException\n"
+"\tdup\n"
+"\tinvokespecial java/util/InputMismatchException/<init>()V\n"
+"\tathrow\n"
+".end method\n\n";
+
+char method_matchRest[] =
+".method private static matchRest(Ljava/lang/String;)V\n"
+".limit stack 3\n"
+".limit locals 2\n"
+"\ticonst_0\n"
+"\tistore_1\n"
+"Loop:\n"
+"\tiload_1\n"
+"\taload_0\n"
+"\tinvokevirtual java/lang/String/length()I\n"
+"\tif_icmpge End\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tbipush 32\n"
+"\tior\n"
+"\taload_0\n"
+"\tiload_1\n"
+"\tinvokevirtual java/lang/String/charAt(I)C\n"
+"\tif_icmpne Exception\n"
+"\tiinc 1 1\n"
+"\tgoto Loop\n"
+"End:\n"
+"\tinvokestatic %s/readByte()I\n"
+"\tbipush 32\n"
+"\tif_icmpgt Exception\n"
+"\treturn\n"
+"Exception:\n"
+"\tnew	java/util/InputMismatchException\n"
+"\tdup\n"
+"\tinvokespecial java/util/InputMismatchException/<init>()V\n"
+"\tathrow\n"
+".end method\n\n";
+
+/* The fast output runtime collects output in a byte buffer of its own, which
+ * is flushed when main returns and, through a shutdown hook that runs the
+ * class as a Runnable, when the program exits abnormally.
+ */
+char fields_fast_output[] =
+".field private static final outbuf [B\n"
+".field private static outpos I\n";
+
+char clinit_fast_output[] =
+"\tldc 65536\n"
+"\tnewarray byte\n"
+"\tputstatic %s/outbuf [B\n"
+"\tinvokestatic java/lang/Runtime/getRuntime()Ljava/lang/Runtime;\n"
+"\tnew	java/lang/Thread\n"
+"\tdup\n"
+"\tnew	%s\n"
+"\tdup\n"
+"\tinvokespecial %s/<init>()V\n"
+"\tinvokespecial java/lang/Thread/<init>(Ljava/lang/Runnable;)V\n"
+"\tinvokevirtual java/lang/Runtime/addShutdownHook(Ljava/lang/Thread;)V\n";
+
+char method_run[] =
+".method public run()V\n"
+".limit stack 0\n"
+".limit locals 1\n"
+"\tinvokestatic %s/flushOut()V\n"
+"\treturn\n"
+".end method\n\n";
+
+char method_flushOut[] =
+".method public static flushOut()V\n"
+".limit stack 4\n"
+".limit locals 0\n"
+"\tgetstatic java/lang/System/out Ljava/io/PrintStream;\n"
+"\tgetstatic %s/outbuf [B\n"
+"\ticonst_0\n"
+"\tgetstatic %s/outpos I\n"
+"\tinvokevirtual java/io/PrintStream/write([BII)V\n"
+"\tgetstatic java/lang/System/out Ljava/io/PrintStream;\n"
+"\tinvokevirtual java/io/PrintStream/flush()V\n"
+"\ticonst_0\n"
+"\tputstatic %s/outpos I\n"
+"\treturn\n"
+".end method\n\n";
+
+char method_printInt[] =
+".method public static printInt(I)V\n"
+".limit stack 5\n"
+".limit locals 3\n"
+"\tgetstatic %s/outpos I\n"
+"\tldc 65525\n"
+"\tif_icmple Room\n"
+"\tinvokestatic %s/flushOut()V\n"
+"Room:\n"
+"\tiload_0\n"
+"\tifge Negate\n"
+"\tgetstatic %s/outbuf [B\n"
+"\tgetstatic %s/outpos I\n"
+"\tdup\n"
+"\ticonst_1\n"
+"\tiadd\n"
+"\tputstatic %s/outpos I\n"
+"\tbipush 45\n"
+"\tbastore\n"
+"\tgoto Count\n"
+"Negate:\n"
+"\tiload_0\n"
+"\tineg\n"
+"\tistore_0\n"
+"Count:\n"
+"\ticonst_1\n"
+"\tistore_1\n"
+"\tiload_0\n"
+"\tistore_2\n"
+"Shorten:\n"
+"\tiload_2\n"
+"\tbipush -9\n"
+"\tif_icmpge Fill\n"
+"\tiload_2\n"
+"\tbipush 10\n"
+"\tidiv\n"
+"\tistore_2\n"
+"\tiinc 1 1\n"
+"\tgoto Shorten\n"
+"Fill:\n"
+"\tgetstatic %s/outpos I\n"
+"\tiload_1\n"
+"\tiadd\n"
+"\tdup\n"
+"\tputstatic %s/outpos I\n"
+"\tistore_2\n"
+"Digit:\n"
+"\tiinc 2 -1\n"
+"\tgetstatic %s/outbuf [B\n"
+"\tiload_2\n"
+"\tbipush 48\n"
+"\tiload_0\n"
+"\tbipush 10\n"
+"\tirem\n"
+"\tisub\n"
+"\tbastore\n"
+"\tiload_0\n"
+"\tbipush 10\n"
+"\tidiv\n"
+"\tdup\n"
+"\tistore_0\n"
+"\tifne Digit\n"
+"\treturn\n"
+".end method\n\n";
+
+char method_printBoolean[] =
+".method public static printBoolean(Z)V\n"
+".limit stack 1\n"
+".limit locals 1\n"
+"\tiload_0\n"
+"\tifeq False\n"
+"\tldc	\"true\"\n"
+"\tinvokestatic %s/printString(Ljava/lang/String;)V\n"
+"\treturn\n"
+"False:\n"
+"\tldc	\"false\"\n"
+"\tinvokestatic %s/printString(Ljava/lang/String;)V\n"
+"\treturn\n"
+".end method\n\n";
+
+/* A string is encoded with the default charset, as PrintStream would encode
+ * it, and copied into the buffer in one go; a string longer than the buffer
+ * is written out directly.
+ */
+char method_printString[] =
+".method public static printString(Ljava/lang/String;)V\n"
+".limit stack 5\n"
+".limit locals 3\n"
+"\taload_0\n"
+"\tinvokevirtual java/lang/String/getBytes()[B\n"
+"\tastore_1\n"
+"\taload_1\n"
+"\tarraylength\n"
+"\tistore_2\n"
+"\tgetstatic %s/outpos I\n"
+"\tiload_2\n"
+"\tiadd\n"
+"\tldc 65536\n"
+"\tif_icmple Room\n"
+"\tinvokestatic %s/flushOut()V\n"
+"\tiload_2\n"
+"\tldc 65536\n"
+"\tif_icmple Room\n"
+"\tgetstatic java/lang/System/out Ljava/io/PrintStream;\n"
+"\taload_1\n"
+"\ticonst_0\n"
+"\tiload_2\n"
+"\tinvokevirtual java/io/PrintStream/write([BII)V\n"
+"\treturn\n"
+"Room:\n"
+"\taload_1\n"
+"\ticonst_0\n"
+"\tgetstatic %s/outbuf [B\n"
+"\tgetstatic %s/outpos I\n"
+"\tiload_2\n"
+"\tinvokestatic java/lang/System/arraycopy"
+"(Ljava/lang/Object;ILjava/lang/Object;II)V\n"
+"\tgetstatic %s/outpos I\n"
+"\tiload_2\n"
+"\tiadd\n"
+"\tputstatic %s/outpos I\n"
+"\treturn\n"
+".end method\n\n";
+
+/* A memoised function is compiled under its name with the suffix $body, and
+ * a wrapper under the original name looks its arguments up in a hash map of
+ * its own before it calls the body.  The arguments form a long key in local
+ * 2, the map is kept in local 4, and the result in local 5.
+ */
+char fields_memo[] =
+".field private static final memo [Ljava/util/HashMap;\n";
+
+char clinit_memo[] =
+"\tdup\n"
+"\tanewarray java/util/HashMap\n"
+"\tputstatic %s/memo [Ljava/util/HashMap;\n"
+"MemoNext:\n"
+"\ticonst_1\n"
+"\tisub\n"
+"\tdup\n"
+"\tiflt MemoDone\n"
+"\tdup\n"
+"\tgetstatic %s/memo [Ljava/util/HashMap;\n"
+"\tswap\n"
+"\tnew	java/util/HashMap\n"
+"\tdup\n"
+"\tinvokespecial java/util/HashMap/<init>()V\n"
+"\taastore\n"
+"\tgoto MemoNext\n"
+"MemoDone:\n"
+"\tpop\n";
+
+char memo_limits[] =
+".limit stack 5\n"
+".limit locals 6\n";
+
+char memo_key_1[] =
+"\tiload_0\n"
+"\ti2l\n";
+
+char memo_key_2[] =
+"\tiload_0\n"
+"\ti2l\n"
+"\tldc 32\n"
+"\tlshl\n"
+"\tiload_1\n"
+"\ti2l\n"
+"\tldc 32\n"
+"\tlshl\n"
+"\tldc 32\n"
+"\tlushr\n"
+"\tlor\n";
+
+char memo_map[] =
+"\tlstore_2\n"
+"\tgetstatic %s/memo [Ljava/util/HashMap;\n";
+
+char memo_lookup[] =
+"\taaload\n"
+"\tastore 4\n"
+"\taload 4\n"
+"\tlload_2\n"
+"\tinvokestatic java/lang/Long/valueOf(J)Ljava/lang/Long;\n"
+"\tinvokevirtual java/util/HashMap/get(Ljava/lang/Object;)Ljava/lang/Object;\n"
+"\tdup\n"
+"\tifnull Compute\n"
+"\tcheckcast java/lang/Integer\n"
+"\tinvokevirtual java/lang/Integer/intValue()I\n"
+"\tireturn\n"
+"Compute:\n"
+"\tpop\n";
+
+char memo_store[] =
+"\tistore 5\n"
+"\taload 4\n"
+"\tlload_2\n"
+"\tinvokestatic java/lang/Long/valueOf(J)Ljava/lang/Long;\n"
+"\tiload 5\n"
+"\tinvokestatic java/lang/Integer/valueOf(I)Ljava/lang/Integer;\n"
+"\tinvokevirtual java/util/HashMap/put"
+"(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;\n"
+"\tpop\n"
+"\tiload 5\n"
+"\tireturn\n"
+".end method\n\n";
+
 char ref_print_boolean[] = "java/io/PrintStream/print(Z)V";
 char ref_print_integer[] = "java/io/PrintStream/print(I)V";
 char ref_print_stream[] = "java/lang/System/out Ljava/io/PrintStream;";
 char ref_print_string[] = "java/io/PrintStream/print(Ljava/lang/String;)V";
+
+#define REF_APPEND_BOOLEAN                                                     \
+	"java/lang/StringBuilder/append(Z)Ljava/lang/StringBuilder;"
+#define REF_APPEND_INTEGER                                                     \
+	"java/lang/StringBuilder/append(I)Ljava/lang/StringBuilder;"
+#define REF_APPEND_STRING                                                      \
+	"java/lang/StringBuilder/append(Ljava/lang/String;)"                      \
+	"Ljava/lang/StringBuilder;"
+#define REF_TO_STRING "java/lang/StringBuilder/toString()Ljava/lang/String;"
 char *ref_read_boolean; /* must be set in set_class_name */
 char *ref_read_integer; /* must be set in set_class_name */
+char *ref_fast_print_boolean; /* must be set in set_class_name */
+char *ref_fast_print_integer; /* must be set in set_class_name */
+char *ref_fast_print_string;  /* must be set in set_class_name */
+char *ref_fast_flush;         /* must be set in set_class_name */
 
 #define REF_READ_BOOLEAN "/readBoolean()Z"
 #define REF_READ_INTEGER "/readInt()I"
+#define REF_FAST_PRINT_BOOLEAN "/printBoolean(Z)V"
+#define REF_FAST_PRINT_INTEGER "/printInt(I)V"
+#define REF_FAST_PRINT_STRING  "/printString(Ljava/lang/String;)V"
+#define REF_FAST_FLUSH         "/flushOut()V"
 
 /* --- global static variables ---------------------------------------------- */
 
+/* Each entry is indexed by its own opcode, so that the table does not depend
+ * on the order of the Bytecode enumeration.
+ */
 static BC instruction_set[] = {
-{"aload",         0, 1},
-{"areturn",       1, 0},
-{"astore",        1, 0},
-{"getstatic",     0, 1},
-{"goto",          0, 0},
-{"iadd",          2, 1},
-{"iaload",        2, 1},
-{"iand",          2, 1},
-{"iastore",       3, 0},
-{"idiv",          2, 1},
-{"ifeq",          1, 0},
-{"if_icmpeq",     2, 0},
-{"if_icmpge",     2, 0},
-{"if_icmpgt",     2, 0},
-{"if_icmple",     2, 0},
-{"if_icmplt",     2, 0},
-{"if_icmpne",     2, 0},
-{"iload",         0, 1},
-{"imul",          2, 1},
-{"ineg",          1, 1},
-{"invokestatic",  0, 1},
-{"invokevirtual", 0, 0},
-{"ior",           2, 1},
-{"istore",        1, 0},
-{"isub",          2, 1},
-{"irem",          2, 1},
-{"ireturn",       1, 0},
-{"ixor",          2, 1},
-{"ldc",           0, 1},
-{"newarray",      1, 1},
-{"return",        0, 0},
-{"swap",          2, 2}
+[JVM_ALOAD]          = {"aload",         0, 1},
+[JVM_ARETURN]        = {"areturn",       1, 0},
+[JVM_ASTORE]         = {"astore",        1, 0},
+[JVM_BALOAD]         = {"baload",        2, 1},
+[JVM_BASTORE]        = {"bastore",       3, 0},
+[JVM_DUP]            = {"dup",           1, 2},
+[JVM_DUP2]           = {"dup2",          2, 4},
+[JVM_DUP_X1]         = {"dup_x1",        2, 3},
+[JVM_GETSTATIC]      = {"getstatic",     0, 1},
+[JVM_GOTO]           = {"goto",          0, 0},
+[JVM_IADD]           = {"iadd",          2, 1},
+[JVM_IALOAD]         = {"iaload",        2, 1},
+[JVM_IAND]           = {"iand",          2, 1},
+[JVM_IASTORE]        = {"iastore",       3, 0},
+[JVM_IDIV]           = {"idiv",          2, 1},
+[JVM_IFEQ]           = {"ifeq",          1, 0},
+[JVM_IF_ICMPEQ]      = {"if_icmpeq",     2, 0},
+[JVM_IF_ICMPGE]      = {"if_icmpge",     2, 0},
+[JVM_IF_ICMPGT]      = {"if_icmpgt",     2, 0},
+[JVM_IF_ICMPLE]      = {"if_icmple",     2, 0},
+[JVM_IF_ICMPLT]      = {"if_icmplt",     2, 0},
+[JVM_IF_ICMPNE]      = {"if_icmpne",     2, 0},
+[JVM_IINC]           = {"iinc",          0, 0},
+[JVM_ILOAD]          = {"iload",         0, 1},
+[JVM_IMUL]           = {"imul",          2, 1},
+[JVM_INEG]           = {"ineg",          1, 1},
+[JVM_INVOKESPECIAL]  = {"invokespecial", 1, 0},
+[JVM_INVOKESTATIC]   = {"invokestatic",  0, 1},
+[JVM_INVOKEVIRTUAL]  = {"invokevirtual", 0, 0},
+[JVM_IOR]            = {"ior",           2, 1},
+[JVM_ISHL]           = {"ishl",          2, 1},
+[JVM_ISHR]           = {"ishr",          2, 1},
+[JVM_ISTORE]         = {"istore",        1, 0},
+[JVM_ISUB]           = {"isub",          2, 1},
+[JVM_IREM]           = {"irem",          2, 1},
+[JVM_IRETURN]        = {"ireturn",       1, 0},
+[JVM_IUSHR]          = {"iushr",         2, 1},
+[JVM_IXOR]           = {"ixor",          2, 1},
+[JVM_LDC]            = {"ldc",           0, 1},
+[JVM_LOOKUPSWITCH]   = {"lookupswitch",  1, 0},
+[JVM_NEW]            = {"new",           0, 1},
+[JVM_NEWARRAY]       = {"newarray",      1, 1},
+[JVM_RETURN]         = {"return",        0, 0},
+[JVM_SWAP]           = {"swap",          2, 2},
+[JVM_TABLESWITCH]    = {"tableswitch",   1, 0}
 };
 
 static const char *java_types[] = {"boolean", "char",  "float", "double",
@@ -198,15 +777,61 @@ static const char *java_types[] = {"boolean", "char",  "float", "double",
 #define NBYTECODES   (sizeof(instruction_set) / sizeof(BC))
 #define INITIAL_SIZE 1024
 #define JASM_EXT     ".jasmin"
+#define BUFFER_SIZE  (1 << 16)
+#define FLUSH_SIZE   (1 << 20)
+#define IOV_BATCH    64
+#define ARENA_BLOCK  (1 << 16)
+#define INITIAL_PIECES 16
+#define CACHED_STREAM  (-1)
+#define MAX_ELEMENT    64
+#define INLINE_BUDGET  24
+#define EVAL_STEPS     100000
+#define EVAL_DEPTH     64
+
+/* The JVM passes parameter k of a static method in local slot k, and the
+ * symbol table numbers the parameters of a subroutine to match.  Every slot
+ * the code generator derives for a parameter goes through this rule.
+ */
+#define PARAM_SLOT(k) (k)
+
+static size_t opcode_len[NBYTECODES]; /**< lengths of the opcode strings */
 
-static char *class_name;    /**< the class name                             */
-static char *function_name; /**< the name of current function               */
-static char *jasm_name;     /**< the jasmin file name                       */
-static int code_size;       /**< the current code array size                */
-static int ip;              /**< the instruction pointer                    */
-static Body *bodies;        /**< list of function bodies                    */
-static Code *code;          /**< the generated code                         */
-static IDPropt *idprop;     /**< id properties of the current function      */
+static char *class_name;          /**< the class name                         */
+static char *function_name;       /**< the name of current function           */
+static char *jasm_name;           /**< the jasmin file name                   */
+static int code_size;             /**< the current code array size            */
+static int ip;                    /**< the instruction pointer                */
+static Body *bodies;              /**< list of function bodies                */
+static Code *code;                /**< the generated code                     */
+static IDPropt *idprop;           /**< id properties of the current function  */
+static Stats stats;               /**< statistics of the optimisation passes  */
+static unsigned int options;      /**< the enabled code generation options    */
+static int dump_threads;          /**< threads used to serialise the methods  */
+static char **strings;            /**< the string table for string operands   */
+static unsigned int nstrings;     /**< the number of strings in the table     */
+static unsigned int strings_size; /**< the allocated size of the string table */
+static HashTab *interned;         /**< string table indices by content        */
+static HashTab *descriptors;      /**< descriptor indices by subroutine name  */
+static HashTab *inlinable;        /**< small bodies by method descriptor      */
+static HashTab *pure;             /**< pure bodies by method descriptor       */
+static int nmemo;                 /**< the number of memoised methods         */
+static int inline_budget;         /**< the instructions of an inlined body    */
+static ArenaBlock *arena;         /**< the memory of the code generation data */
+static Label next_label;          /**< the next label to hand out             */
+static FILE *stream_file;         /**< the code file in streaming mode        */
+static Buffer stream_buf;         /**< the output buffer in streaming mode    */
+static Piece *pieces;             /**< the pieces of the current output       */
+static int npieces;               /**< the number of coalesced pieces         */
+static int nprints;               /**< the number of pieces as written        */
+static int pieces_size;           /**< the allocated number of pieces         */
+static Buffer print_text;         /**< the text of the constant pieces        */
+static int print_start;           /**< start of the output, or -1 outside one */
+static int piece_start;           /**< the start of the current piece         */
+static int outer_max_depth;       /**< the stack depth outside the output     */
+static int uses_input;            /**< whether the program reads any input    */
+static int uses_stream;           /**< whether the stream is cached in a slot */
+static Label entry_label;         /**< the entry of the method, or 0 for main */
+static unsigned int self_desc;    /**< the descriptor of the current method   */
 
 int stack_depth, max_stack_depth;
 
@@ -214,42 +839,187 @@ int stack_depth, max_stack_depth;
 
 static void ensure_space(int num_instr);
 static void adjust_stack(BC *instr);
+static int instr_width(Body *b, int i);
+static void label_range(Body *b, int *lo, int *hi);
+static unsigned int intern_string(const char *string);
+static void *arena_alloc(size_t n);
+static char *arena_strdup(const char *s);
+static void arena_release(void);
+static unsigned int method_descriptor(const char *fname, IDPropt *p);
+static void optimise_body(Body *b);
+static void replace_code(Body *b, Code *out, int n);
+static void inline_calls(Body *b);
+static void keep_inlinable(Body *b);
+static Body *inline_callee(Body *b, int i);
+static int check_purity(Body *b);
+static int is_small(Body *b);
+static void prune_call_graph(void);
+static void link_callees(Body *b, HashTab *methods);
+static void lower_switches(Body *b);
+static int is_case_test(Body *b, int i, int *slot, int *key);
+static int cmp_case_key(const void *p, const void *q);
+static void eliminate_dead_code(Body *b);
+static void thread_jumps(Body *b);
+static void pack_locals(Body *b);
+static void assign_hot_slots(Body *b);
+static void stream_method(Body *b);
+static char *class_ref(const char *member);
+static void gen_ref(Bytecode opcode, const char *ref, short pop, short push);
+static void gen_stream(void);
+static void cache_stream(int slot);
+static int fold_constants(Bytecode opcode);
+static int gen_increment(int slot);
+static int reduce_strength(Bytecode opcode);
+static void reuse_element(void);
+static int fuse_branch(Label label);
+static int eliminate_tail_call(void);
+static int evaluate_call(char *fname, IDPropt *p);
+static int interpret(Body *b, int *args, int depth, int *steps, int *result);
+static int is_constant(int i);
+static void add_print_text(const char *s, size_t n);
+static void add_print_value(ValType type);
+static void gen_saved_piece(Code *saved, int base, Piece *p, int depth);
+static int has_effects(Code *saved, int base, Piece *p);
+static void gen_print_piece(Code *saved, int base, Piece *p, int depth);
+static void gen_print_concat(Code *saved, int base, int first, int end,
+                             int depth);
+static void buf_init(Buffer *buf, size_t size);
+static void buf_put(Buffer *buf, const char *s, size_t n);
+static void buf_puts(Buffer *buf, const char *s);
+static void buf_putint(Buffer *buf, int n);
+static void buf_subst(Buffer *buf, const char *tmpl, const char *s);
+static void buf_flush(Buffer *buf, FILE *file);
+static void buf_free(Buffer *buf);
 
 /* --- code generation interface -------------------------------------------- */
 
 void init_code_generation(void)
 {
+	unsigned int i;
+
 	bodies = NULL;
+	arena = NULL;
+	next_label = 1;
+	stream_file = NULL;
+	code = emalloc(sizeof(Code) * INITIAL_SIZE);
+	code_size = INITIAL_SIZE;
+	strings = emalloc(INITIAL_SIZE * sizeof(char *));
+	nstrings = 0;
+	strings_size = INITIAL_SIZE;
+	interned = ht_init(0.75f, shift_hash, key_strcmp);
+	descriptors = ht_init(0.75f, shift_hash, key_strcmp);
+	inlinable = ht_init(0.75f, shift_hash, key_strcmp);
+	pure = ht_init(0.75f, shift_hash, key_strcmp);
+	if (interned == NULL || descriptors == NULL || inlinable == NULL ||
+	    pure == NULL) {
+		eprintf("String tables could not be initialised");
+	}
+	for (i = 0; i < NBYTECODES; i++) {
+		opcode_len[i] = strlen(instruction_set[i].instr);
+	}
+	pieces = emalloc(INITIAL_PIECES * sizeof(Piece));
+	pieces_size = INITIAL_PIECES;
+	buf_init(&print_text, INITIAL_SIZE);
+	print_start = -1;
+	uses_input = FALSE;
+	options = 0;
+	dump_threads = 1;
+	inline_budget = INLINE_BUDGET;
+	nmemo = 0;
+	memset(&stats, 0, sizeof(Stats));
+}
+
+void set_codegen_options(unsigned int flags)
+{
+	options = flags;
+}
+
+void set_dump_threads(int nthreads)
+{
+	dump_threads = (nthreads > 1) ? nthreads : 1;
+}
+
+void set_inline_budget(int ninstrs)
+{
+	inline_budget = (ninstrs > 0) ? ninstrs : 0;
 }
 
 void init_subroutine_codegen(const char *name, IDPropt *p)
 {
 	max_stack_depth = stack_depth = 0;
 	ip = 0;
-	code = emalloc(sizeof(Code) * INITIAL_SIZE);
-	code_size = INITIAL_SIZE;
-	function_name = estrdup(name);
+	uses_stream = FALSE;
+	function_name = arena_strdup(name);
 	idprop = p;
+
+	/* build the descriptor once, for all the call sites, and mark the entry
+	 * as the target of self-calls in tail position
+	 */
+	entry_label = 0;
+	self_desc = 0;
+	if (p != NULL && strcmp(name, "main") != 0) {
+		self_desc = method_descriptor(name, p);
+		entry_label = get_label();
+		gen_label(entry_label);
+	}
 }
 
 void close_subroutine_codegen(int varwidth)
 {
-	Body *body;
+	Body *body, streamed;
 
-	body = emalloc(sizeof(Body));
+	body = (options & OPT_STREAM) ? &streamed : arena_alloc(sizeof(Body));
 
-	/* populate new body */
+	/* populate new body; the code array is reused for the next subroutine */
 	body->name = function_name;
 	body->idprop = idprop;
+	body->desc = self_desc;
 	body->code = code;
 	body->ip = ip;
 	body->max_stack_depth = max_stack_depth;
 	body->variables_width = varwidth;
+	body->bytes_saved = 0;
+	body->memo = -1;
+	body->callees = NULL;
+	body->ncallees = 0;
+	body->fan_in = 0;
+	body->reachable = FALSE;
+
+	/* the cached stream takes the first slot after the variables */
+	if (uses_stream) {
+		cache_stream(varwidth);
+		body->code = code;
+		body->ip = ip;
+		body->variables_width++;
+	}
+
+	optimise_body(body);
+
+	/* a memoised function is only reached through its memo table */
+	if (check_purity(body) && (options & OPT_MEMOISE) &&
+	    body->idprop->type != TYPE_CALLABLE &&
+	    !IS_ARRAY_TYPE(body->idprop->type) && body->idprop->nparams >= 1 &&
+	    body->idprop->nparams <= 2) {
+		body->memo = nmemo++;
+		stats.memoised++;
+	} else {
+		keep_inlinable(body);
+	}
+
+	/* in streaming mode, the method is written out and not kept */
+	if (options & OPT_STREAM) {
+		stream_method(body);
+		return;
+	}
+
+	body->code = arena_alloc(body->ip * sizeof(Code));
+	memcpy(body->code, code, body->ip * sizeof(Code));
 
 	/* link into list */
 	if (bodies != NULL) {
 		bodies->prev = body;
 		body->next = bodies;
+		body->prev = NULL;
 		bodies = body;
 	} else {
 		bodies = body;
@@ -269,15 +1039,12 @@ void set_class_name(char *cname)
 	strcpy(jasm_name, class_name);
 	strncat(jasm_name, JASM_EXT, sizeof(JASM_EXT));
 
-#pragma GCC diagnostic ignored "-Wsizeof-pointer-memaccess"
-	ref_read_boolean = emalloc(class_name_len + sizeof(REF_READ_BOOLEAN));
-	strcpy(ref_read_boolean, class_name);
-	strncat(ref_read_boolean, REF_READ_BOOLEAN, sizeof(REF_READ_BOOLEAN));
-
-	ref_read_integer = emalloc(class_name_len + sizeof(REF_READ_INTEGER));
-	strcpy(ref_read_integer, class_name);
-	strncat(ref_read_integer, REF_READ_INTEGER, sizeof(REF_READ_INTEGER));
-#pragma GCC diagnostic warning "-Wsizeof-pointer-memaccess"
+	ref_read_boolean = class_ref(REF_READ_BOOLEAN);
+	ref_read_integer = class_ref(REF_READ_INTEGER);
+	ref_fast_print_boolean = class_ref(REF_FAST_PRINT_BOOLEAN);
+	ref_fast_print_integer = class_ref(REF_FAST_PRINT_INTEGER);
+	ref_fast_print_string = class_ref(REF_FAST_PRINT_STRING);
+	ref_fast_flush = class_ref(REF_FAST_FLUSH);
 }
 
 void assemble(const char *jasmin_path)
@@ -307,6 +1074,25 @@ void assemble(const char *jasmin_path)
 
 void gen_1(Bytecode opcode)
 {
+	/* the buffered output must be written out before main returns */
+	if (opcode == JVM_RETURN && (options & OPT_FAST_OUTPUT)
+	    && strcmp(function_name, "main") == 0) {
+		gen_ref(JVM_INVOKESTATIC, ref_fast_flush, 0, 0);
+	}
+
+	if ((opcode == JVM_IRETURN || opcode == JVM_ARETURN ||
+	     opcode == JVM_RETURN) && eliminate_tail_call()) {
+		return;
+	}
+
+	if (fold_constants(opcode) || reduce_strength(opcode)) {
+		return;
+	}
+
+	if (opcode == JVM_IALOAD || opcode == JVM_BALOAD) {
+		reuse_element();
+	}
+
 	ensure_space(1);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -317,6 +1103,10 @@ void gen_1(Bytecode opcode)
 
 void gen_2(Bytecode opcode, int operand)
 {
+	if (opcode == JVM_ISTORE && gen_increment(operand)) {
+		return;
+	}
+
 	ensure_space(2);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -330,45 +1120,17 @@ void gen_2(Bytecode opcode, int operand)
 
 void gen_call(char *fname, IDPropt *idprop)
 {
-	char *fpath;
-	unsigned int i;
+	if (evaluate_call(fname, idprop)) {
+		return;
+	}
 
 	ensure_space(2);
 
 	code[ip].type = CODE_INSTRUCTION;
 	code[ip++].code = JVM_INVOKESTATIC;
 
-	/* 6 + 2 * idprop->nparams:
-	 *  -- 1 for '\0'
-	 *  -- 2 for '(' and ')' of parameter list
-	 *  -- 1 for '.' separating class from method name
-	 *  -- 2 for return type, including possibility of array type
-	 * the multiplier of 2 includes the possibilities of array types
-	 */
-	fpath = emalloc(strlen(class_name) + strlen(fname) +
-	                (6 + 2 * idprop->nparams) * sizeof(char));
-	strcpy(fpath, class_name);
-	strcat(fpath, ".");
-	strcat(fpath, fname);
-	strcat(fpath, "(");
-	for (i = 0; i < idprop->nparams; i++) {
-		if (IS_ARRAY_TYPE(idprop->params[i])) {
-			strcat(fpath, "[");
-		}
-		strcat(fpath, "I");
-	}
-	strcat(fpath, ")");
-	if (IS_ARRAY_TYPE(idprop->type)) {
-		strcat(fpath, "[");
-	}
-	if (idprop->type == TYPE_CALLABLE) {
-		strcat(fpath, "V");
-	} else {
-		strcat(fpath, "I");
-	}
-
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE | CODE_ALLOCATED;
-	code[ip++].string = fpath;
+	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
+	code[ip++].str = method_descriptor(fname, idprop);
 
 	adjust_stack(&instruction_set[JVM_INVOKESTATIC]);
 }
@@ -377,6 +1139,10 @@ void gen_cmp(Bytecode opcode)
 {
 	int l1, l2;
 
+	if (fold_constants(opcode)) {
+		return;
+	}
+
 	/* unnecessary to adjust stack depth or to ensure space, since both are
 	 * handled in the other gen functions
 	 */
@@ -400,6 +1166,10 @@ void gen_label(Label label)
 
 void gen_2_label(Bytecode opcode, Label label)
 {
+	if (opcode == JVM_IFEQ && fuse_branch(label)) {
+		return;
+	}
+
 	ensure_space(2); /* 3? */
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -426,13 +1196,29 @@ void gen_newarray(JVMatype atype)
 
 void gen_print(ValType type)
 {
-	ensure_space(5);
+	if (IS_CALLABLE_TYPE(type)) {
+		SET_RETURN_TYPE(type);
+	}
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_GETSTATIC;
+	if (print_start >= 0) {
+		add_print_value(type);
+		return;
+	}
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_stream;
+	if (options & OPT_FAST_OUTPUT) {
+		if (type == TYPE_BOOLEAN) {
+			gen_ref(JVM_INVOKESTATIC, ref_fast_print_boolean, 1, 0);
+		} else if (type == TYPE_INTEGER) {
+			gen_ref(JVM_INVOKESTATIC, ref_fast_print_integer, 1, 0);
+		} else {
+			assert(FALSE);
+		}
+		return;
+	}
+
+	gen_stream();
+
+	ensure_space(3);
 
 	code[ip].type = CODE_INSTRUCTION;
 	code[ip++].code = JVM_SWAP;
@@ -441,51 +1227,120 @@ void gen_print(ValType type)
 	code[ip++].code = JVM_INVOKEVIRTUAL;
 
 	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	if (IS_CALLABLE_TYPE(type)) {
-		SET_RETURN_TYPE(type);
-	}
 	if (type == TYPE_BOOLEAN) {
-		code[ip++].string = ref_print_boolean;
+		code[ip++].str = intern_string(ref_print_boolean);
 	} else if (type == TYPE_INTEGER) {
-		code[ip++].string = ref_print_integer;
+		code[ip++].str = intern_string(ref_print_integer);
 	} else {
 		assert(FALSE);
 	}
 
-	adjust_stack(&instruction_set[JVM_GETSTATIC]);
 	adjust_stack(&instruction_set[JVM_SWAP]);
 	adjust_stack(&instruction_set[JVM_INVOKEVIRTUAL]);
 }
 
 void gen_print_string(char *string)
 {
-	ensure_space(6);
+	if (print_start >= 0) {
+		add_print_text(string, strlen(string));
+		free(string);
+		return;
+	}
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_GETSTATIC;
+	if (options & OPT_FAST_OUTPUT) {
+		ensure_space(2);
+		code[ip].type = CODE_INSTRUCTION;
+		code[ip++].code = JVM_LDC;
+		code[ip].type = CODE_OPERAND | CODE_STRING;
+		code[ip++].str = intern_string(string);
+		free(string);
+		adjust_stack(&instruction_set[JVM_LDC]);
+		gen_ref(JVM_INVOKESTATIC, ref_fast_print_string, 1, 0);
+		return;
+	}
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_stream;
+	gen_stream();
+
+	ensure_space(4);
 
 	code[ip].type = CODE_INSTRUCTION;
 	code[ip++].code = JVM_LDC;
 
-	code[ip].type = CODE_OPERAND | CODE_STRING | CODE_ALLOCATED;
-	code[ip++].string = string;
+	code[ip].type = CODE_OPERAND | CODE_STRING;
+	code[ip++].str = intern_string(string);
+	free(string);
 
 	code[ip].type = CODE_INSTRUCTION;
 	code[ip++].code = JVM_INVOKEVIRTUAL;
 
 	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_string;
+	code[ip++].str = intern_string(ref_print_string);
 
-	adjust_stack(&instruction_set[JVM_GETSTATIC]);
 	adjust_stack(&instruction_set[JVM_LDC]);
 	adjust_stack(&instruction_set[JVM_INVOKEVIRTUAL]);
 }
 
+void gen_print_begin(void)
+{
+	print_start = piece_start = ip;
+	npieces = nprints = 0;
+	print_text.len = 0;
+
+	/* track how deep the pieces take the stack on their own */
+	outer_max_depth = max_stack_depth;
+	max_stack_depth = stack_depth;
+}
+
+void gen_print_end(void)
+{
+	Code *saved;
+	int i, j, n, depth, start, nruns;
+
+	/* take the code of the computed pieces out of the code array */
+	start = print_start;
+	n = ip - start;
+	saved = emalloc((n > 0 ? n : 1) * sizeof(Code));
+	memcpy(saved, code + start, n * sizeof(Code));
+	ip = start;
+	depth = max_stack_depth - stack_depth;
+	if (outer_max_depth > max_stack_depth) {
+		max_stack_depth = outer_max_depth;
+	}
+	print_start = -1;
+
+	if (npieces == 1 || (options & OPT_FAST_OUTPUT)) {
+		/* a single piece, or pieces the buffered runtime prints directly */
+		for (i = 0; i < npieces; i++) {
+			gen_print_piece(saved, start, &pieces[i], depth);
+		}
+		stats.prints_saved += nprints - npieces;
+	} else if (npieces > 1) {
+		/* concatenate runs of pieces with one StringBuilder each; a piece
+		 * that may print or throw starts a new run, so that everything
+		 * before it is printed by the time its code runs */
+		nruns = 0;
+		for (i = 0; i < npieces; i = j) {
+			j = i + 1;
+			while (j < npieces && !has_effects(saved, start, &pieces[j])) {
+				j++;
+			}
+			if (j - i == 1) {
+				gen_print_piece(saved, start, &pieces[i], depth);
+			} else {
+				gen_print_concat(saved, start, i, j, depth);
+			}
+			nruns++;
+		}
+		stats.prints_saved += nprints - nruns;
+	}
+
+	free(saved);
+}
+
 void gen_read(ValType type)
 {
+	uses_input = TRUE;
+
 	ensure_space(2);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -493,9 +1348,9 @@ void gen_read(ValType type)
 
 	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
 	if (type == TYPE_BOOLEAN) {
-		code[ip++].string = ref_read_boolean;
+		code[ip++].str = intern_string(ref_read_boolean);
 	} else if (type == TYPE_INTEGER) {
-		code[ip++].string = ref_read_integer;
+		code[ip++].str = intern_string(ref_read_integer);
 	} else {
 		assert(FALSE);
 	}
@@ -505,8 +1360,7 @@ void gen_read(ValType type)
 
 Label get_label(void)
 {
-	static Label label = 1;
-	return label++;
+	return next_label++;
 }
 
 const char *get_opcode_string(Bytecode opcode)
@@ -521,8 +1375,15 @@ const char *get_opcode_string(Bytecode opcode)
 /* --- code dumping --------------------------------------------------------- */
 
 static void dump_code(FILE *file);
-static void dump_method(FILE *file, Body *b);
-static void dump_preamble(FILE *file, char *name);
+static void dump_code_parallel(FILE *file);
+static void *dump_worker(void *arg);
+static void dump_method(Buffer *buf, Body *b);
+static int dump_switch(Buffer *buf, Body *b, int i);
+static void dump_signature(Buffer *buf, Body *b);
+static void dump_memo(Buffer *buf, Body *b);
+static void dump_preamble(Buffer *buf, char *name);
+static void dump_runtime(Buffer *buf, char *name);
+static void write_buffers(FILE *file, Buffer *bufs, int n);
 
 void list_code(void)
 {
@@ -532,83 +1393,2545 @@ void list_code(void)
 void dump_code(FILE *obj_file)
 {
 	Body *b;
+	Buffer out;
+
+	if (dump_threads > 1) {
+		dump_code_parallel(obj_file);
+		return;
+	}
+
+	buf_init(&out, BUFFER_SIZE);
 
 	/* preamble */
-	dump_preamble(obj_file, class_name);
+	dump_preamble(&out, class_name);
 
-	/* dump the methods */
+	/* dump the methods, writing the output in large chunks */
 	for (b = bodies; b; b = b->next) {
-		dump_method(obj_file, b);
+		dump_method(&out, b);
+		if (out.len >= FLUSH_SIZE) {
+			buf_flush(&out, obj_file);
+		}
 	}
+
+	buf_flush(&out, obj_file);
+	buf_free(&out);
 }
 
-void make_code_file(void)
+void list_statistics(void)
 {
-	FILE *obj_file;
+	int i;
+	Body *b;
 
-	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
-		eprintf("Could not open code file:");
+	printf("unreachable instructions removed:  %d\n", stats.dead_code);
+	printf("adjacent labels merged:            %d\n", stats.labels_merged);
+	printf("jumps threaded through a goto:     %d\n", stats.jumps_threaded);
+	printf("jumps to next instruction removed: %d\n", stats.jumps_removed);
+	printf("local variable slots saved:        %d\n", stats.slots_saved);
+	printf("operations folded into constants:  %d\n", stats.folded);
+	printf("output calls saved by coalescing:  %d\n", stats.prints_saved);
+	printf("assignments turned into iinc:      %d\n", stats.increments);
+	printf("array operands reused with dup2:   %d\n", stats.reloads_saved);
+	printf("multiplications turned to shifts:  %d\n", stats.muls_reduced);
+	printf("divisions turned to shifts:        %d\n", stats.divs_reduced);
+	printf("remainders turned to masks:        %d\n", stats.rems_reduced);
+	printf("comparisons fused with branches:   %d\n", stats.branches_fused);
+	printf("if chains turned into switches:    %d\n", stats.switches);
+	printf("calls inlined:                     %d\n", stats.inlined);
+	printf("tail calls turned into jumps:      %d\n", stats.tail_calls);
+	printf("pure subroutines:                  %d\n", stats.pure);
+	printf("functions memoised:                %d\n", stats.memoised);
+	printf("calls evaluated at compile time:   %d\n", stats.evaluated);
+	printf("unreachable subroutines removed:   %d\n", stats.dead_methods);
+	for (b = bodies; b; b = b->next) {
+		printf("bytes saved by slot assignment in %s: %d\n", b->name,
+		       b->bytes_saved);
+	}
+	for (b = bodies; b; b = b->next) {
+		printf("calls in %s (fan-in %d, fan-out %d):", b->name, b->fan_in,
+		       b->ncallees);
+		for (i = 0; i < b->ncallees; i++) {
+			printf(" %s", b->callees[i]->name);
+		}
+		printf("\n");
+	}
+}
+
+void make_code_file(void)
+{
+	FILE *obj_file;
+
+	if (options & OPT_STREAM) {
+		if (stream_file != NULL) {
+			dump_runtime(&stream_buf, class_name);
+			buf_flush(&stream_buf, stream_file);
+			buf_free(&stream_buf);
+			fclose(stream_file);
+			stream_file = NULL;
+		}
+		return;
+	}
+
+	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
+		eprintf("Could not open code file:");
+	}
+
+	prune_call_graph();
+	dump_code(obj_file);
+
+	fclose(obj_file);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+static void ensure_space(int num_instr)
+{
+	if (ip + num_instr > code_size) {
+		while (ip + num_instr > code_size) {
+			code_size *= 2;
+		}
+		code = erealloc(code, code_size * sizeof(Code));
+	}
+}
+
+/**
+ * Interns a string or reference operand in the string table, so that all
+ * operands with the same content share one copy.  The table keeps its own copy
+ * of the string.
+ *
+ * @param[in] string the string to intern.
+ * @return           the index of the string in the table.
+ */
+static unsigned int intern_string(const char *string)
+{
+	unsigned int *idx;
+
+	if ((idx = ht_search(interned, (void *) string)) != NULL) {
+		return *idx;
+	}
+
+	if (nstrings == strings_size) {
+		strings_size *= 2;
+		strings = erealloc(strings, strings_size * sizeof(char *));
+	}
+	strings[nstrings] = arena_strdup(string);
+	idx = arena_alloc(sizeof(unsigned int));
+	*idx = nstrings;
+	if (ht_insert(interned, strings[nstrings], idx) != EXIT_SUCCESS) {
+		eprintf("Could not intern string operand");
+	}
+
+	return nstrings++;
+}
+
+/**
+ * Returns the string table index of the descriptor of a subroutine, building
+ * and interning the descriptor the first time the subroutine is seen.
+ *
+ * @param[in] fname the name of the subroutine.
+ * @param[in] p     the properties of the subroutine.
+ * @return          the index of the descriptor in the string table.
+ */
+static unsigned int method_descriptor(const char *fname, IDPropt *p)
+{
+	char *fpath, *q;
+	unsigned int i, *idx;
+
+	if ((idx = ht_search(descriptors, (void *) fname)) != NULL) {
+		return *idx;
+	}
+
+	/* 6 + 2 * p->nparams:
+	 *  -- 1 for '\0'
+	 *  -- 2 for '(' and ')' of parameter list
+	 *  -- 1 for '.' separating class from method name
+	 *  -- 2 for return type, including possibility of array type
+	 * the multiplier of 2 includes the possibilities of array types
+	 */
+	fpath = emalloc(strlen(class_name) + strlen(fname) +
+	                (6 + 2 * p->nparams) * sizeof(char));
+	strcpy(fpath, class_name);
+	q = fpath + strlen(fpath);
+	*q++ = '.';
+	strcpy(q, fname);
+	q += strlen(q);
+	*q++ = '(';
+	for (i = 0; i < p->nparams; i++) {
+		if (IS_ARRAY_TYPE(p->params[i])) {
+			*q++ = '[';
+			*q++ = IS_BOOLEAN_TYPE(p->params[i]) ? 'Z' : 'I';
+		} else {
+			*q++ = 'I';
+		}
+	}
+	*q++ = ')';
+	if (p->type == TYPE_CALLABLE) {
+		*q++ = 'V';
+	} else if (IS_ARRAY_TYPE(p->type)) {
+		*q++ = '[';
+		*q++ = IS_BOOLEAN_TYPE(p->type) ? 'Z' : 'I';
+	} else {
+		*q++ = 'I';
+	}
+	*q = '\0';
+
+	idx = arena_alloc(sizeof(unsigned int));
+	*idx = intern_string(fpath);
+	free(fpath);
+	if (ht_insert(descriptors, arena_strdup(fname), idx) != EXIT_SUCCESS) {
+		eprintf("Could not record method descriptor");
+	}
+
+	return *idx;
+}
+
+/**
+ * Allocates memory from the code generation arena.  The memory is suitably
+ * aligned for any type, and is only released by <code>arena_release</code>.
+ *
+ * @param[in] n the number of bytes to allocate.
+ * @return      a pointer to the allocated memory.
+ */
+static void *arena_alloc(size_t n)
+{
+	ArenaBlock *block;
+	size_t size;
+	void *p;
+
+	n = (n + sizeof(max_align_t) - 1) / sizeof(max_align_t) *
+	    sizeof(max_align_t);
+	if (arena == NULL || arena->used + n > arena->size) {
+		size = (n > ARENA_BLOCK) ? n : ARENA_BLOCK;
+		block = emalloc(sizeof(ArenaBlock) + size);
+		block->used = 0;
+		block->size = size;
+		block->next = arena;
+		arena = block;
+	}
+	p = (char *) arena->data + arena->used;
+	arena->used += n;
+
+	return p;
+}
+
+/**
+ * Copies a string into the code generation arena.
+ *
+ * @param[in] s the string to copy.
+ * @return      a pointer to the copy.
+ */
+static char *arena_strdup(const char *s)
+{
+	size_t n;
+	char *p;
+
+	n = strlen(s) + 1;
+	p = arena_alloc(n);
+	memcpy(p, s, n);
+
+	return p;
+}
+
+/**
+ * Releases all the memory of the code generation arena in one go.
+ */
+static void arena_release(void)
+{
+	ArenaBlock *block;
+
+	while (arena != NULL) {
+		block = arena;
+		arena = arena->next;
+		free(block);
+	}
+}
+
+/**
+ * Computes the net change in the stack depth caused by the instruction, and
+ * updates the maximum stack depth if necessary.
+ *
+ * @param[in] instr the instruction for which to factor in the stack effect.
+ */
+static void adjust_stack(BC *instr)
+{
+	stack_depth += instr->push;
+	if (stack_depth > max_stack_depth) {
+		max_stack_depth = stack_depth;
+	}
+	stack_depth -= instr->pop;
+}
+
+/**
+ * Returns a newly allocated reference to a member of the generated class.
+ *
+ * @param[in] member the member name and descriptor, starting with a slash.
+ * @return           the class name followed by the member.
+ */
+static char *class_ref(const char *member)
+{
+	char *ref;
+
+	ref = emalloc(strlen(class_name) + strlen(member) + 1);
+	strcpy(ref, class_name);
+	strcat(ref, member);
+
+	return ref;
+}
+
+/**
+ * Generates an instruction with a reference operand.
+ *
+ * @param[in] opcode the instruction.
+ * @param[in] ref    the class, field or method the instruction refers to.
+ * @param[in] pop    the number of values the instruction takes from the stack.
+ * @param[in] push   the number of values the instruction leaves on the stack.
+ */
+static void gen_ref(Bytecode opcode, const char *ref, short pop, short push)
+{
+	BC instr = {instruction_set[opcode].instr, pop, push};
+
+	ensure_space(2);
+
+	code[ip].type = CODE_INSTRUCTION;
+	code[ip++].code = opcode;
+
+	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
+	code[ip++].str = intern_string(ref);
+
+	adjust_stack(&instr);
+}
+
+/**
+ * Generates the load of the PrintStream for an output call: from the reserved
+ * local slot if the stream is cached, else from <code>System.out</code>.
+ */
+static void gen_stream(void)
+{
+	if (!(options & OPT_CACHE_STREAM)) {
+		gen_ref(JVM_GETSTATIC, ref_print_stream, 0, 1);
+		return;
+	}
+
+	/* the slot is only known once the subroutine is closed */
+	gen_2(JVM_ALOAD, CACHED_STREAM);
+	uses_stream = TRUE;
+}
+
+/**
+ * Loads <code>System.out</code> into the specified local slot on entry to the
+ * current subroutine, and lets the loads of the cached stream use that slot.
+ *
+ * @param[in] slot the reserved local slot.
+ */
+static void cache_stream(int slot)
+{
+	int i;
+
+	for (i = 0; i < ip; i++) {
+		if (code[i].type == CODE_INSTRUCTION && code[i].code == JVM_ALOAD
+		    && code[i + 1].num == CACHED_STREAM) {
+			code[i + 1].num = slot;
+		}
+	}
+
+	ensure_space(4);
+	memmove(code + 4, code, ip * sizeof(Code));
+	ip += 4;
+
+	code[0].type = CODE_INSTRUCTION;
+	code[0].code = JVM_GETSTATIC;
+	code[1].type = CODE_OPERAND | CODE_REFERENCE;
+	code[1].str = intern_string(ref_print_stream);
+	code[2].type = CODE_INSTRUCTION;
+	code[2].code = JVM_ASTORE;
+	code[3].type = CODE_OPERAND | CODE_INTEGER;
+	code[3].num = slot;
+}
+
+/**
+ * Returns whether the code element at the specified index is an instruction
+ * that pushes an integer constant.
+ *
+ * @param[in] i the index into the code array.
+ * @return      <code>TRUE</code> if the element is an <code>ldc</code> of an
+ *              integer, <code>FALSE</code> otherwise.
+ */
+static int is_constant(int i)
+{
+	return i >= 0 && code[i].type == CODE_INSTRUCTION
+	       && code[i].code == JVM_LDC
+	       && code[i + 1].type == (CODE_OPERAND | CODE_INTEGER);
+}
+
+/**
+ * Evaluates the specified operation at compile time if its operands are the
+ * constants generated just before it, and replaces them by the result.  Since
+ * a label would separate the operands from the operation, the operands are
+ * certain to be the values the operation would take from the stack.
+ *
+ * @param[in] opcode an arithmetic or logical instruction, or a comparison as
+ *                   passed to <code>gen_cmp</code>.
+ * @return           <code>TRUE</code> if the operation was folded,
+ *                   <code>FALSE</code> if it must be generated.
+ */
+static int fold_constants(Bytecode opcode)
+{
+	int a, b, r;
+	unsigned int ua, ub;
+
+	if (!is_constant(ip - 2)) {
+		return FALSE;
+	}
+	b = code[ip - 1].num;
+	ub = (unsigned int) b;
+
+	if (opcode == JVM_INEG) {
+		ip -= 2;
+		stack_depth--;
+		gen_2(JVM_LDC, (int) (0u - ub));
+		stats.folded++;
+		return TRUE;
+	}
+
+	if (!is_constant(ip - 4)) {
+		return FALSE;
+	}
+	a = code[ip - 3].num;
+	ua = (unsigned int) a;
+
+	/* Java arithmetic wraps around, so compute it unsigned */
+	switch (opcode) {
+		case JVM_IADD:
+			r = (int) (ua + ub);
+			break;
+		case JVM_ISUB:
+			r = (int) (ua - ub);
+			break;
+		case JVM_IMUL:
+			r = (int) (ua * ub);
+			break;
+		case JVM_IDIV:
+		case JVM_IREM:
+			/* leave the exception to run time, and avoid overflow here */
+			if (b == 0 || (a == INT_MIN && b == -1)) {
+				return FALSE;
+			}
+			r = (opcode == JVM_IDIV) ? a / b : a % b;
+			break;
+		case JVM_IAND:
+			r = a & b;
+			break;
+		case JVM_IOR:
+			r = a | b;
+			break;
+		case JVM_IXOR:
+			r = a ^ b;
+			break;
+		case JVM_IF_ICMPEQ:
+			r = (a == b);
+			break;
+		case JVM_IF_ICMPGE:
+			r = (a >= b);
+			break;
+		case JVM_IF_ICMPGT:
+			r = (a > b);
+			break;
+		case JVM_IF_ICMPLE:
+			r = (a <= b);
+			break;
+		case JVM_IF_ICMPLT:
+			r = (a < b);
+			break;
+		case JVM_IF_ICMPNE:
+			r = (a != b);
+			break;
+		default:
+			return FALSE;
+	}
+
+	ip -= 4;
+	stack_depth -= 2;
+	gen_2(JVM_LDC, r);
+	stats.folded++;
+	return TRUE;
+}
+
+/**
+ * Replaces a multiplication, division or remainder by a power of two, that is
+ * generated just before the operation, by shifts and masks.  Since Java's
+ * division truncates towards zero, a negative dividend is biased by the
+ * divisor less one before it is shifted or masked, as follows:
+ *
+ * <pre>
+ *     t = (x &gt;&gt; 31) &gt;&gt;&gt; (32 - k)
+ *     x / 2^k = (x + t) &gt;&gt; k
+ *     x % 2^k = ((x + t) &amp; (2^k - 1)) - t
+ * </pre>
+ *
+ * For a multiplication, the constant may also be the first operand, if the
+ * second one is a local variable.
+ *
+ * @param[in] opcode the operation to generate.
+ * @return           <code>TRUE</code> if the operation was reduced,
+ *                   <code>FALSE</code> if it must be generated as is.
+ */
+static int reduce_strength(Bytecode opcode)
+{
+	int c, k, swap;
+
+	if (opcode != JVM_IMUL && opcode != JVM_IDIV && opcode != JVM_IREM) {
+		return FALSE;
+	}
+
+	swap = FALSE;
+	if (is_constant(ip - 2)) {
+		c = code[ip - 1].num;
+	} else if (opcode == JVM_IMUL && is_constant(ip - 4)
+	           && code[ip - 2].type == CODE_INSTRUCTION
+	           && code[ip - 2].code == JVM_ILOAD) {
+		c = code[ip - 3].num;
+		swap = TRUE;
+	} else {
+		return FALSE;
+	}
+
+	if (c < 2 || (c & (c - 1)) != 0) {
+		return FALSE;
+	}
+	for (k = 0; (1 << k) != c; k++)
+		;
+
+	/* c * x becomes x * c, and the constant is replaced by the sequences
+	 * below
+	 */
+	if (swap) {
+		code[ip - 4].code = JVM_ILOAD;
+		code[ip - 3].num = code[ip - 1].num;
+	}
+	ip -= 2;
+	stack_depth--;
+
+	switch (opcode) {
+		case JVM_IMUL:
+			gen_2(JVM_LDC, k);
+			gen_1(JVM_ISHL);
+			stats.muls_reduced++;
+			break;
+		case JVM_IDIV:
+			gen_1(JVM_DUP);
+			gen_2(JVM_LDC, 31);
+			gen_1(JVM_ISHR);
+			gen_2(JVM_LDC, 32 - k);
+			gen_1(JVM_IUSHR);
+			gen_1(JVM_IADD);
+			gen_2(JVM_LDC, k);
+			gen_1(JVM_ISHR);
+			stats.divs_reduced++;
+			break;
+		default:
+			gen_1(JVM_DUP);
+			gen_2(JVM_LDC, 31);
+			gen_1(JVM_ISHR);
+			gen_2(JVM_LDC, 32 - k);
+			gen_1(JVM_IUSHR);
+			gen_1(JVM_DUP_X1);
+			gen_1(JVM_IADD);
+			gen_2(JVM_LDC, c - 1);
+			gen_1(JVM_IAND);
+			gen_1(JVM_SWAP);
+			gen_1(JVM_ISUB);
+			stats.rems_reduced++;
+			break;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Turns the store of <code>x + c</code>, <code>c + x</code> or
+ * <code>x - c</code> into local variable <code>x</code>, generated just before
+ * the store, into <code>iinc x c</code>, provided that the increment fits in
+ * a signed 16-bit integer.  Jasmin uses the <code>wide</code> form of the
+ * instruction by itself when the slot or the increment needs it.
+ *
+ * @param[in] slot the local variable slot the value is to be stored in.
+ * @return         <code>TRUE</code> if the store was turned into an increment,
+ *                 <code>FALSE</code> if it must be generated.
+ */
+static int gen_increment(int slot)
+{
+	long long d;
+	int x, k;
+
+	if (ip < 5 || code[ip - 1].type != CODE_INSTRUCTION
+	    || code[ip - 5].type != CODE_INSTRUCTION) {
+		return FALSE;
+	}
+
+	x = ip - 5;
+	k = ip - 3;
+	if (code[ip - 1].code == JVM_IADD && is_constant(x)) {
+		x = ip - 3;
+		k = ip - 5;
+	} else if (code[ip - 1].code != JVM_IADD
+	           && code[ip - 1].code != JVM_ISUB) {
+		return FALSE;
+	}
+	if (code[x].type != CODE_INSTRUCTION || code[x].code != JVM_ILOAD
+	    || code[x + 1].num != slot || !is_constant(k)) {
+		return FALSE;
+	}
+
+	d = code[k + 1].num;
+	if (code[ip - 1].code == JVM_ISUB) {
+		d = -d;
+	}
+	if (d < -32768 || d > 32767) {
+		return FALSE;
+	}
+
+	/* an increment by zero does nothing at all */
+	ip -= 5;
+	if (d != 0) {
+		code[ip].type = CODE_INSTRUCTION;
+		code[ip++].code = JVM_IINC;
+		code[ip].type = CODE_OPERAND | CODE_INTEGER;
+		code[ip++].num = slot;
+		code[ip].type = CODE_OPERAND | CODE_INTEGER;
+		code[ip++].num = (int) d;
+	}
+	stack_depth--;
+	stats.increments++;
+	return TRUE;
+}
+
+/**
+ * Before an array element is loaded, checks whether the array reference and
+ * index on top of the stack were computed by the same code twice in a row,
+ * as in <code>let a[i] = a[i] + 1</code>, and if so, computes them only once
+ * and duplicates them with <code>dup2</code>.  The code may only load locals
+ * and constants, and do arithmetic and array loads, so that evaluating it a
+ * second time cannot give a different result.  It must also leave exactly the
+ * array reference and the index on the stack, without taking anything from
+ * below them, or it is not the code of one element.
+ */
+static void reuse_element(void)
+{
+	int h, i, start, depth;
+	Code *c;
+
+	for (h = 4; h <= MAX_ELEMENT && 2 * h <= ip; h++) {
+		start = ip - h;
+		if (code[start].type != CODE_INSTRUCTION
+		    || code[start].code != JVM_ALOAD) {
+			continue;
+		}
+
+		for (i = 0; i < h; i++) {
+			c = &code[start + i];
+			if (c->type != code[start - h + i].type
+			    || c->num != code[start - h + i].num) {
+				break;
+			}
+			if (c->type == CODE_INSTRUCTION) {
+				switch (c->code) {
+					case JVM_ALOAD:
+					case JVM_BALOAD:
+					case JVM_IADD:
+					case JVM_IALOAD:
+					case JVM_IAND:
+					case JVM_IDIV:
+					case JVM_ILOAD:
+					case JVM_IMUL:
+					case JVM_INEG:
+					case JVM_IOR:
+					case JVM_IREM:
+					case JVM_ISUB:
+					case JVM_IXOR:
+					case JVM_LDC:
+						continue;
+					default:
+						break;
+				}
+				break;
+			} else if (c->type != (CODE_OPERAND | CODE_INTEGER)) {
+				break;
+			}
+		}
+
+		if (i < h) {
+			continue;
+		}
+
+		/* the code must leave exactly the array and the index on the stack */
+		for (i = depth = 0; i < h && depth >= 0; i++) {
+			c = &code[start + i];
+			if (c->type == CODE_INSTRUCTION) {
+				depth -= instruction_set[c->code].pop;
+				if (depth >= 0) {
+					depth += instruction_set[c->code].push;
+				}
+			}
+		}
+		if (depth == 2) {
+			ip = start;
+			code[ip].type = CODE_INSTRUCTION;
+			code[ip++].code = JVM_DUP2;
+			stats.reloads_saved++;
+			return;
+		}
+	}
+}
+
+/**
+ * Before a branch on a boolean is generated, checks whether the boolean was
+ * just computed by <code>gen_cmp</code>, that is, by the code
+ *
+ * <pre>
+ *     if_icmp&lt;cond&gt; La
+ *     ldc 0
+ *     goto Lb
+ * La:
+ *     ldc 1
+ * Lb:
+ * </pre>
+ *
+ * and if so, replaces the code and the branch by a single comparison that
+ * branches on the opposite condition.  A branch on a constant becomes a jump
+ * or disappears.
+ *
+ * @param[in] label the label to branch to if the boolean is false.
+ * @return          <code>TRUE</code> if the branch was generated here,
+ *                  <code>FALSE</code> if it must still be generated.
+ */
+static int fuse_branch(Label label)
+{
+	Bytecode opcode;
+
+	if (is_constant(ip - 2)) {
+		ip -= 2;
+		stack_depth--;
+		if (code[ip + 1].num == FALSE) {
+			gen_2_label(JVM_GOTO, label);
+		}
+		stats.folded++;
+		return TRUE;
+	}
+
+	if (ip < 10 || code[ip - 10].type != CODE_INSTRUCTION
+	    || code[ip - 6].type != CODE_INSTRUCTION
+	    || code[ip - 6].code != JVM_GOTO
+	    || code[ip - 4].type != CODE_LABEL
+	    || code[ip - 4].label != code[ip - 9].label
+	    || code[ip - 1].type != CODE_LABEL
+	    || code[ip - 1].label != code[ip - 5].label
+	    || !is_constant(ip - 8) || code[ip - 7].num != FALSE
+	    || !is_constant(ip - 3) || code[ip - 2].num != TRUE) {
+		return FALSE;
+	}
+
+	switch (code[ip - 10].code) {
+		case JVM_IF_ICMPEQ:
+			opcode = JVM_IF_ICMPNE;
+			break;
+		case JVM_IF_ICMPNE:
+			opcode = JVM_IF_ICMPEQ;
+			break;
+		case JVM_IF_ICMPGE:
+			opcode = JVM_IF_ICMPLT;
+			break;
+		case JVM_IF_ICMPLT:
+			opcode = JVM_IF_ICMPGE;
+			break;
+		case JVM_IF_ICMPGT:
+			opcode = JVM_IF_ICMPLE;
+			break;
+		case JVM_IF_ICMPLE:
+			opcode = JVM_IF_ICMPGT;
+			break;
+		default:
+			return FALSE;
+	}
+
+	/* the two operands of the comparison are back on top of the stack */
+	ip -= 10;
+	gen_2_label(opcode, label);
+	stats.branches_fused++;
+	return TRUE;
+}
+
+/**
+ * Before a return is generated, checks whether the value to return is
+ * computed by a call of the current method to itself, and if so, replaces the
+ * call by stores of its arguments into the parameters, followed by a jump to
+ * the entry of the method, so that the recursion runs in constant stack space.
+ *
+ * @return <code>TRUE</code> if the call was replaced and the return is no
+ *         longer needed, <code>FALSE</code> otherwise.
+ */
+static int eliminate_tail_call(void)
+{
+	int k;
+
+	if (entry_label == 0 || ip < 2 || code[ip - 2].type != CODE_INSTRUCTION
+	    || code[ip - 2].code != JVM_INVOKESTATIC
+	    || code[ip - 1].str != self_desc) {
+		return FALSE;
+	}
+
+	/* the arguments are on the stack, with the last one on top */
+	ip -= 2;
+	stack_depth -= instruction_set[JVM_INVOKESTATIC].push;
+	for (k = (int) idprop->nparams - 1; k >= 0; k--) {
+		gen_2(IS_ARRAY(idprop->params[k]) ? JVM_ASTORE : JVM_ISTORE,
+		      PARAM_SLOT(k));
+	}
+	gen_2_label(JVM_GOTO, entry_label);
+	stats.tail_calls++;
+	return TRUE;
+}
+
+/**
+ * Before a call is generated, checks whether the callee is a pure method and
+ * all of its arguments are constants generated just before the call, and if
+ * so, runs the callee in the compile-time interpreter and replaces the
+ * arguments by the result.  A call to a pure procedure has no effect, and
+ * disappears once the interpreter has seen it finish.
+ *
+ * @param[in] fname the name of the callee.
+ * @param[in] p     the properties of the callee.
+ * @return          <code>TRUE</code> if the call was evaluated,
+ *                  <code>FALSE</code> if it must be generated.
+ */
+static int evaluate_call(char *fname, IDPropt *p)
+{
+	int k, n, r, steps, *args;
+	Body *callee;
+
+	callee = ht_search(pure, strings[method_descriptor(fname, p)]);
+	if (callee == NULL) {
+		return FALSE;
+	}
+	n = (int) p->nparams;
+	for (k = 0; k < n; k++) {
+		if (!is_constant(ip - 2 * (n - k))) {
+			return FALSE;
+		}
+	}
+
+	args = emalloc((n + 1) * sizeof(int));
+	for (k = 0; k < n; k++) {
+		args[k] = code[ip - 2 * (n - k) + 1].num;
+	}
+	steps = EVAL_STEPS;
+	if (!interpret(callee, args, 0, &steps, &r)) {
+		free(args);
+		return FALSE;
+	}
+	free(args);
+
+	ip -= 2 * n;
+	stack_depth -= n;
+	if (p->type != TYPE_CALLABLE) {
+		gen_2(JVM_LDC, r);
+	}
+	stats.evaluated++;
+	return TRUE;
+}
+
+/**
+ * Runs a pure method on the specified arguments.  The interpreter gives up,
+ * leaving the call to run time, on any instruction it does not know, on a
+ * division by zero, when the calls nest deeper than <code>EVAL_DEPTH</code>,
+ * when the steps of the whole evaluation run out, or on a method whose code
+ * was not kept.  Java arithmetic wraps
+ * around, so it is computed unsigned.
+ *
+ * @param[in]     b      the body of the method.
+ * @param[in]     args   the values of the parameters.
+ * @param[in]     depth  the number of interpreted calls enclosing this one.
+ * @param[in,out] steps  the number of instructions that may still be run.
+ * @param[out]    result the return value, or zero for a procedure.
+ * @return               <code>TRUE</code> if the method returned,
+ *                       <code>FALSE</code> if the interpreter gave up.
+ */
+static int interpret(Body *b, int *args, int depth, int *steps, int *result)
+{
+	int i, k, w, n, sp, lo, hi, width, done, ok, a, v;
+	int *def, *stack, *locals;
+	unsigned int ua, ub;
+	Bytecode op;
+	Body *callee;
+	Code *c;
+
+	if (depth > EVAL_DEPTH || b->code == NULL) {
+		return FALSE;
+	}
+
+	c = b->code;
+	label_range(b, &lo, &hi);
+	def = emalloc((hi - lo + 1) * sizeof(int));
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			def[c[i].label - lo] = i;
+		}
+	}
+	width = b->variables_width;
+	if (width < PARAM_SLOT((int) b->idprop->nparams)) {
+		width = PARAM_SLOT((int) b->idprop->nparams);
+	}
+	locals = emalloc(width * sizeof(int));
+	memset(locals, 0, width * sizeof(int));
+	for (k = 0; k < (int) b->idprop->nparams; k++) {
+		locals[PARAM_SLOT(k)] = args[k];
+	}
+	stack = emalloc((b->max_stack_depth + 1) * sizeof(int));
+
+	sp = 0;
+	done = ok = FALSE;
+	for (i = 0; !done && i < b->ip && --*steps > 0; i += w) {
+		w = instr_width(b, i);
+		if (c[i].type != CODE_INSTRUCTION) {
+			continue;
+		}
+		op = c[i].code;
+		if ((unsigned long) op >= NBYTECODES ||
+		    sp < instruction_set[op].pop ||
+		    sp - instruction_set[op].pop + instruction_set[op].push >
+		        b->max_stack_depth) {
+			break;
+		}
+
+		switch (op) {
+			case JVM_LDC:
+				if (c[i + 1].type != (CODE_OPERAND | CODE_INTEGER)) {
+					done = TRUE;
+					break;
+				}
+				stack[sp++] = c[i + 1].num;
+				break;
+			case JVM_ILOAD:
+			case JVM_ISTORE:
+				if (c[i + 1].num >= width) {
+					done = TRUE;
+				} else if (op == JVM_ILOAD) {
+					stack[sp++] = locals[c[i + 1].num];
+				} else {
+					locals[c[i + 1].num] = stack[--sp];
+				}
+				break;
+			case JVM_IADD:
+			case JVM_ISUB:
+			case JVM_IMUL:
+			case JVM_IAND:
+			case JVM_IOR:
+			case JVM_IXOR:
+				ua = (unsigned int) stack[sp - 2];
+				ub = (unsigned int) stack[sp - 1];
+				sp--;
+				stack[sp - 1] = (int) ((op == JVM_IADD) ? ua + ub
+				                       : (op == JVM_ISUB) ? ua - ub
+				                       : (op == JVM_IMUL) ? ua * ub
+				                       : (op == JVM_IAND) ? ua & ub
+				                       : (op == JVM_IOR)  ? ua | ub
+				                                          : ua ^ ub);
+				break;
+			case JVM_IDIV:
+			case JVM_IREM:
+				a = stack[sp - 2];
+				v = stack[sp - 1];
+				if (v == 0) {
+					done = TRUE;
+					break;
+				}
+				sp--;
+				if (v == -1) {
+					/* avoid the overflow of INT_MIN / -1 */
+					stack[sp - 1] =
+					    (op == JVM_IDIV) ? (int) (0u - (unsigned int) a) : 0;
+				} else {
+					stack[sp - 1] = (op == JVM_IDIV) ? a / v : a % v;
+				}
+				break;
+			case JVM_INEG:
+				stack[sp - 1] = (int) (0u - (unsigned int) stack[sp - 1]);
+				break;
+			case JVM_IINC:
+				if (c[i + 1].num >= width) {
+					done = TRUE;
+					break;
+				}
+				locals[c[i + 1].num] =
+				    (int) ((unsigned int) locals[c[i + 1].num] +
+				           (unsigned int) c[i + 2].num);
+				break;
+			case JVM_ISHL:
+			case JVM_ISHR:
+			case JVM_IUSHR:
+				ua = (unsigned int) stack[sp - 2];
+				ub = (unsigned int) stack[sp - 1] & 31;
+				sp--;
+				if (op == JVM_ISHL) {
+					stack[sp - 1] = (int) (ua << ub);
+				} else if (op == JVM_IUSHR) {
+					stack[sp - 1] = (int) (ua >> ub);
+				} else {
+					stack[sp - 1] = stack[sp - 1] >> ub;
+				}
+				break;
+			case JVM_SWAP:
+				v = stack[sp - 1];
+				stack[sp - 1] = stack[sp - 2];
+				stack[sp - 2] = v;
+				break;
+			case JVM_DUP:
+				stack[sp] = stack[sp - 1];
+				sp++;
+				break;
+			case JVM_DUP2:
+				stack[sp] = stack[sp - 2];
+				stack[sp + 1] = stack[sp - 1];
+				sp += 2;
+				break;
+			case JVM_DUP_X1:
+				stack[sp] = stack[sp - 1];
+				stack[sp - 1] = stack[sp - 2];
+				stack[sp - 2] = stack[sp];
+				sp++;
+				break;
+			case JVM_GOTO:
+				w = def[c[i + 1].label - lo] - i;
+				break;
+			case JVM_IFEQ:
+				if (stack[--sp] == 0) {
+					w = def[c[i + 1].label - lo] - i;
+				}
+				break;
+			case JVM_IF_ICMPEQ:
+			case JVM_IF_ICMPGE:
+			case JVM_IF_ICMPGT:
+			case JVM_IF_ICMPLE:
+			case JVM_IF_ICMPLT:
+			case JVM_IF_ICMPNE:
+				a = stack[sp - 2];
+				v = stack[sp - 1];
+				sp -= 2;
+				if ((op == JVM_IF_ICMPEQ && a == v) ||
+				    (op == JVM_IF_ICMPGE && a >= v) ||
+				    (op == JVM_IF_ICMPGT && a > v) ||
+				    (op == JVM_IF_ICMPLE && a <= v) ||
+				    (op == JVM_IF_ICMPLT && a < v) ||
+				    (op == JVM_IF_ICMPNE && a != v)) {
+					w = def[c[i + 1].label - lo] - i;
+				}
+				break;
+			case JVM_TABLESWITCH:
+				v = stack[--sp];
+				k = (v >= c[i + 1].num && v <= c[i + 2].num)
+				        ? i + 3 + (v - c[i + 1].num)
+				        : i + w - 1;
+				w = def[c[k].label - lo] - i;
+				break;
+			case JVM_LOOKUPSWITCH:
+				v = stack[--sp];
+				for (k = i + 1; k < i + w - 1 && c[k].num != v; k += 2)
+					;
+				k = (k < i + w - 1) ? k + 1 : i + w - 1;
+				w = def[c[k].label - lo] - i;
+				break;
+			case JVM_INVOKESTATIC:
+				callee = ht_search(pure, strings[c[i + 1].str]);
+				if (callee == NULL) {
+					done = TRUE;
+					break;
+				}
+				n = (int) callee->idprop->nparams;
+				if (sp < n || !interpret(callee, stack + sp - n, depth + 1,
+				                         steps, &v)) {
+					done = TRUE;
+					break;
+				}
+				sp -= n;
+				if (callee->idprop->type != TYPE_CALLABLE) {
+					if (sp >= b->max_stack_depth) {
+						done = TRUE;
+						break;
+					}
+					stack[sp++] = v;
+				}
+				break;
+			case JVM_IRETURN:
+				*result = stack[sp - 1];
+				done = ok = TRUE;
+				break;
+			case JVM_RETURN:
+				*result = 0;
+				done = ok = TRUE;
+				break;
+			default:
+				done = TRUE;
+				break;
+		}
+	}
+
+	free(stack);
+	free(locals);
+	free(def);
+	return ok;
+}
+
+/**
+ * Adds constant text to the current output statement, joining it to the text
+ * of the previous piece, if any.
+ *
+ * @param[in] s the text, as it appears in a Jasmin string constant.
+ * @param[in] n the length of the text.
+ */
+static void add_print_text(const char *s, size_t n)
+{
+	nprints++;
+	piece_start = ip;
+
+	if (n == 0) {
+		return;
+	}
+
+	buf_put(&print_text, s, n);
+	if (npieces > 0 && pieces[npieces - 1].type == TYPE_NONE) {
+		pieces[npieces - 1].end = print_text.len;
+		return;
+	}
+
+	if (npieces == pieces_size) {
+		pieces_size *= 2;
+		pieces = erealloc(pieces, pieces_size * sizeof(Piece));
+	}
+	pieces[npieces].type = TYPE_NONE;
+	pieces[npieces].start = print_text.len - n;
+	pieces[npieces++].end = print_text.len;
+}
+
+/**
+ * Adds the value just computed to the current output statement.  A constant
+ * value is turned into text; the code of any other value is recorded, to be
+ * laid out when the statement ends.
+ *
+ * @param[in] type the type of the value.
+ */
+static void add_print_value(ValType type)
+{
+	char digits[12];
+	int n;
+
+	/* the value is consumed by the statement */
+	stack_depth--;
+
+	if (ip - piece_start == 2 && is_constant(piece_start)) {
+		n = code[piece_start + 1].num;
+		ip = piece_start;
+		if (type == TYPE_BOOLEAN) {
+			add_print_text(n ? "true" : "false", n ? 4 : 5);
+		} else {
+			add_print_text(digits, snprintf(digits, sizeof(digits), "%d", n));
+		}
+		return;
+	}
+
+	nprints++;
+	if (npieces == pieces_size) {
+		pieces_size *= 2;
+		pieces = erealloc(pieces, pieces_size * sizeof(Piece));
+	}
+	pieces[npieces].type = type;
+	pieces[npieces].start = piece_start;
+	pieces[npieces++].end = ip;
+	piece_start = ip;
+}
+
+/**
+ * Generates the code of a computed piece of an output statement again, and
+ * accounts for the value it leaves on the stack.
+ *
+ * @param[in] saved the saved code of the statement.
+ * @param[in] base  the original position of the saved code.
+ * @param[in] p     the piece.
+ * @param[in] depth the stack depth the code of the pieces needs at most.
+ */
+static void gen_saved_piece(Code *saved, int base, Piece *p, int depth)
+{
+	int n;
+
+	n = p->end - p->start;
+	ensure_space(n);
+	memcpy(code + ip, saved + p->start - base, n * sizeof(Code));
+	ip += n;
+
+	if (stack_depth + depth > max_stack_depth) {
+		max_stack_depth = stack_depth + depth;
+	}
+	stack_depth++;
+}
+
+/**
+ * Returns whether the code of a piece of an output statement may have an
+ * effect that must not come before the earlier pieces are printed, that is,
+ * whether it calls a method, divides, or loads from an array.
+ *
+ * @param[in] saved the saved code of the statement.
+ * @param[in] base  the original position of the saved code.
+ * @param[in] p     the piece.
+ * @return          whether the code of the piece may print or throw.
+ */
+static int has_effects(Code *saved, int base, Piece *p)
+{
+	int i;
+	Code *c;
+
+	if (p->type == TYPE_NONE) {
+		return FALSE;
+	}
+
+	for (i = p->start; i < p->end; i++) {
+		c = &saved[i - base];
+		if (c->type != CODE_INSTRUCTION) {
+			continue;
+		}
+		switch (c->code) {
+			case JVM_INVOKESTATIC:
+			case JVM_INVOKEVIRTUAL:
+			case JVM_IDIV:
+			case JVM_IREM:
+			case JVM_IALOAD:
+			case JVM_BALOAD:
+				return TRUE;
+			default:
+				break;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Generates the code that prints a single piece of an output statement.
+ *
+ * @param[in] saved the saved code of the statement.
+ * @param[in] base  the original position of the saved code.
+ * @param[in] p     the piece.
+ * @param[in] depth the stack depth the code of the pieces needs at most.
+ */
+static void gen_print_piece(Code *saved, int base, Piece *p, int depth)
+{
+	char *text;
+
+	if (p->type == TYPE_NONE) {
+		text = emalloc(p->end - p->start + 1);
+		memcpy(text, print_text.data + p->start, p->end - p->start);
+		text[p->end - p->start] = '\0';
+		gen_print_string(text);
+	} else if ((options & OPT_CACHE_STREAM) && !(options & OPT_FAST_OUTPUT)) {
+		/* load the stream first, so that no swap is needed */
+		gen_stream();
+		gen_saved_piece(saved, base, p, depth);
+		gen_ref(JVM_INVOKEVIRTUAL, p->type == TYPE_BOOLEAN ? ref_print_boolean
+		                                                   : ref_print_integer,
+		        2, 0);
+	} else {
+		gen_saved_piece(saved, base, p, depth);
+		gen_print(p->type);
+	}
+}
+
+/**
+ * Generates the code that concatenates a run of pieces of an output
+ * statement with a StringBuilder, and prints the result at once.
+ *
+ * @param[in] saved the saved code of the statement.
+ * @param[in] base  the original position of the saved code.
+ * @param[in] first the index of the first piece of the run.
+ * @param[in] end   the index just past the last piece of the run.
+ * @param[in] depth the stack depth the code of the pieces needs at most.
+ */
+static void gen_print_concat(Code *saved, int base, int first, int end,
+                             int depth)
+{
+	char *text;
+	int i;
+	Piece *p;
+
+	gen_stream();
+	gen_ref(JVM_NEW, "java/lang/StringBuilder", 0, 1);
+	gen_1(JVM_DUP);
+	gen_ref(JVM_INVOKESPECIAL, "java/lang/StringBuilder/<init>()V", 1, 0);
+	for (i = first; i < end; i++) {
+		p = &pieces[i];
+		if (p->type == TYPE_NONE) {
+			text = emalloc(p->end - p->start + 1);
+			memcpy(text, print_text.data + p->start, p->end - p->start);
+			text[p->end - p->start] = '\0';
+			ensure_space(2);
+			code[ip].type = CODE_INSTRUCTION;
+			code[ip++].code = JVM_LDC;
+			code[ip].type = CODE_OPERAND | CODE_STRING;
+			code[ip++].str = intern_string(text);
+			adjust_stack(&instruction_set[JVM_LDC]);
+			free(text);
+			gen_ref(JVM_INVOKEVIRTUAL, REF_APPEND_STRING, 2, 1);
+		} else {
+			gen_saved_piece(saved, base, p, depth);
+			gen_ref(JVM_INVOKEVIRTUAL, p->type == TYPE_BOOLEAN
+			                               ? REF_APPEND_BOOLEAN
+			                               : REF_APPEND_INTEGER,
+			        2, 1);
+		}
+	}
+	gen_ref(JVM_INVOKEVIRTUAL, REF_TO_STRING, 1, 1);
+	gen_ref(JVM_INVOKEVIRTUAL, ref_print_string, 2, 0);
+}
+
+/* --- optimisation passes ------------------------------------------------- */
+
+#define IS_ICMP(op)                                                            \
+	((op) == JVM_IF_ICMPEQ || (op) == JVM_IF_ICMPNE ||                         \
+	 (op) == JVM_IF_ICMPLT || (op) == JVM_IF_ICMPLE ||                         \
+	 (op) == JVM_IF_ICMPGT || (op) == JVM_IF_ICMPGE)
+
+#define IS_BRANCH(op) ((op) == JVM_GOTO || (op) == JVM_IFEQ || IS_ICMP(op))
+
+#define IS_SWITCH(op) ((op) == JVM_TABLESWITCH || (op) == JVM_LOOKUPSWITCH)
+
+#define ENDS_FLOW(op)                                                          \
+	((op) == JVM_GOTO || (op) == JVM_ARETURN || (op) == JVM_IRETURN ||         \
+	 (op) == JVM_RETURN || IS_SWITCH(op))
+
+#define IS_LOCAL_ACCESS(op)                                                    \
+	((op) == JVM_ILOAD || (op) == JVM_ISTORE || (op) == JVM_ALOAD ||           \
+	 (op) == JVM_ASTORE || (op) == JVM_IINC)
+
+/**
+ * Returns the number of code elements occupied by the instruction at the
+ * specified index, that is, one for the opcode and one for each of its
+ * operands.
+ *
+ * @param[in] b the body containing the instruction.
+ * @param[in] i the index of the instruction in the code array.
+ * @return      the number of code elements of the instruction.
+ */
+static int instr_width(Body *b, int i)
+{
+	int w;
+
+	for (w = 1; i + w < b->ip && (b->code[i + w].type & CODE_OPERAND); w++)
+		;
+
+	return w;
+}
+
+/**
+ * Returns the number of local variable slots whose numbers are fixed by the
+ * calling convention, namely the parameters, or the argument array of
+ * <code>main</code>.
+ *
+ * @param[in] b the body of the method.
+ * @return      the number of fixed slots.
+ */
+static int fixed_slots(Body *b)
+{
+	if (b->idprop != NULL && strcmp(b->name, "main") != 0) {
+		return PARAM_SLOT((int) b->idprop->nparams);
+	}
+	return 1;
+}
+
+/**
+ * Returns the number of bytecode bytes taken by a load, store or increment of
+ * the specified local variable slot.
+ *
+ * @param[in] op   the instruction.
+ * @param[in] slot the local variable slot.
+ * @return         the size of the instruction in bytes.
+ */
+static int local_access_size(Bytecode op, int slot)
+{
+	if (op == JVM_IINC) {
+		return (slot < 256) ? 3 : 6;
+	} else if (slot < 4) {
+		return 1;
+	} else if (slot < 256) {
+		return 2;
+	} else {
+		return 4;
+	}
+}
+
+/**
+ * Finds the smallest and largest label, defined or referenced, in a body.  If
+ * the body contains no labels, both are set to zero.
+ *
+ * @param[in]  b  the body of the method.
+ * @param[out] lo the smallest label.
+ * @param[out] hi the largest label.
+ */
+static void label_range(Body *b, int *lo, int *hi)
+{
+	int i;
+
+	*lo = *hi = 0;
+	for (i = 0; i < b->ip; i++) {
+		if (b->code[i].type & CODE_LABEL) {
+			if (*lo == 0 || b->code[i].label < *lo) {
+				*lo = b->code[i].label;
+			}
+			if (b->code[i].label > *hi) {
+				*hi = b->code[i].label;
+			}
+		}
+	}
+}
+
+/**
+ * Runs the optimisation passes over the body of a method that has just been
+ * closed.
+ *
+ * @param[in] b the body of the method.
+ */
+static void optimise_body(Body *b)
+{
+	inline_calls(b);
+	lower_switches(b);
+	eliminate_dead_code(b);
+	thread_jumps(b);
+	eliminate_dead_code(b);
+	if (options & OPT_PACK_LOCALS) {
+		pack_locals(b);
+	}
+	assign_hot_slots(b);
+}
+
+/**
+ * Replaces the code of a body, which must be the code array itself, by the
+ * specified code.  The code array grows as needed.
+ *
+ * @param[in] b   the body of the method.
+ * @param[in] out the new code.
+ * @param[in] n   the number of elements of the new code.
+ */
+static void replace_code(Body *b, Code *out, int n)
+{
+	ip = b->ip;
+	ensure_space(n - ip);
+	memcpy(code, out, n * sizeof(Code));
+	b->code = code;
+	b->ip = ip = n;
+}
+
+/**
+ * Returns the kept body of the method that an <code>invokestatic</code> calls,
+ * if the body is small enough to be inlined.
+ *
+ * @param[in] b the body of the caller.
+ * @param[in] i the index of the instruction in the code array.
+ * @return      the body of the callee, or <code>NULL</code> if the call is to
+ *              be kept.
+ */
+static Body *inline_callee(Body *b, int i)
+{
+	if ((b->code[i].type & MASK_TYPE) != CODE_INSTRUCTION ||
+	    b->code[i].code != JVM_INVOKESTATIC) {
+		return NULL;
+	}
+	return ht_search(inlinable, strings[b->code[i + 1].str]);
+}
+
+/**
+ * Replaces each call to a method small enough to be inlined by a copy of the
+ * body of the method.  The arguments are stored into fresh local variables
+ * that follow those of the caller, the labels of the copy are renamed, and
+ * every return becomes a jump to the end of the copy, with the return value,
+ * if any, left on the stack.  The limits of the caller grow to make room for
+ * the locals and stack of the callee.
+ *
+ * @param[in] b the body of the method; its code must be the code array.
+ */
+static void inline_calls(Body *b)
+{
+	int i, j, k, m, n, base, width, depth, lo, hi;
+	Label first, end;
+	Body *callee;
+	Code *c, *out;
+
+	if (inline_budget == 0) {
+		return;
+	}
+
+	/* every return of a callee may grow into a goto */
+	c = b->code;
+	n = b->ip;
+	for (i = 0; i < b->ip; i++) {
+		if ((callee = inline_callee(b, i)) != NULL) {
+			n += 2 * callee->ip + 2 * (int) callee->idprop->nparams + 1;
+		}
+	}
+	if (n == b->ip) {
+		return;
+	}
+
+	out = emalloc(n * sizeof(Code));
+	width = b->variables_width;
+	depth = b->max_stack_depth;
+	for (i = m = 0; i < b->ip; i++) {
+		if ((callee = inline_callee(b, i)) == NULL) {
+			out[m++] = c[i];
+			continue;
+		}
+		i++;
+
+		/* the arguments are on the stack, with the last one on top */
+		base = width;
+		width += callee->variables_width;
+		for (k = (int) callee->idprop->nparams - 1; k >= 0; k--) {
+			out[m].type = CODE_INSTRUCTION;
+			out[m++].code = IS_ARRAY(callee->idprop->params[k]) ? JVM_ASTORE
+			                                                     : JVM_ISTORE;
+			out[m].type = CODE_OPERAND | CODE_INTEGER;
+			out[m++].num = base + PARAM_SLOT(k);
+		}
+
+		label_range(callee, &lo, &hi);
+		first = next_label - lo;
+		next_label += hi - lo + 1;
+		end = get_label();
+		for (j = 0; j < callee->ip; j++) {
+			out[m] = callee->code[j];
+			if (out[m].type & CODE_LABEL) {
+				out[m].label += first;
+			} else if (out[m].type == CODE_INSTRUCTION &&
+			           IS_LOCAL_ACCESS(out[m].code)) {
+				out[++m] = callee->code[++j];
+				out[m].num += base;
+			} else if (out[m].type == CODE_INSTRUCTION &&
+			           (out[m].code == JVM_IRETURN ||
+			            out[m].code == JVM_ARETURN ||
+			            out[m].code == JVM_RETURN)) {
+				out[m++].code = JVM_GOTO;
+				out[m].type = CODE_OPERAND | CODE_LABEL;
+				out[m].label = end;
+			}
+			m++;
+		}
+		out[m].type = CODE_LABEL;
+		out[m++].label = end;
+
+		/* the arguments made room for the stack of the callee */
+		if (b->max_stack_depth - (int) callee->idprop->nparams +
+		        callee->max_stack_depth > depth) {
+			depth = b->max_stack_depth - (int) callee->idprop->nparams +
+			        callee->max_stack_depth;
+		}
+		stats.inlined++;
+	}
+
+	replace_code(b, out, m);
+	b->variables_width = width;
+	b->max_stack_depth = depth;
+	free(out);
+}
+
+/**
+ * Keeps a copy of an optimised body for inlining, if the method is neither
+ * <code>main</code> nor recursive, and if its instructions fit the inlining
+ * budget.  In streaming mode, all of its code must fit, as for
+ * <code>is_small</code>.
+ *
+ * @param[in] b the body of the method.
+ */
+static void keep_inlinable(Body *b)
+{
+	int i, n;
+	unsigned int desc;
+	Body *copy;
+
+	if (b->idprop == NULL || strcmp(b->name, "main") == 0) {
+		return;
+	}
+
+	if ((options & OPT_STREAM) && !is_small(b)) {
+		return;
+	}
+
+	desc = b->desc;
+	for (i = n = 0; i < b->ip; i++) {
+		if ((b->code[i].type & MASK_TYPE) != CODE_INSTRUCTION) {
+			continue;
+		}
+		if (++n > inline_budget || (b->code[i].code == JVM_INVOKESTATIC &&
+		                            b->code[i + 1].str == desc)) {
+			return;
+		}
+	}
+
+	copy = arena_alloc(sizeof(Body));
+	*copy = *b;
+	copy->code = arena_alloc(b->ip * sizeof(Code));
+	memcpy(copy->code, b->code, b->ip * sizeof(Code));
+	if (ht_insert(inlinable, strings[desc], copy) != EXIT_SUCCESS) {
+		eprintf("Could not record inlinable method");
+	}
+}
+
+/**
+ * Decides whether a method is pure, that is, whether it neither reads input
+ * nor writes output, takes no array parameters, writes to no array, and only
+ * calls itself or methods already found to be pure.  The body of a pure
+ * method is kept by its descriptor, so that its callers can be found pure in
+ * turn, and so that calls to it can be evaluated at compile time.
+ *
+ * @param[in] b the body of the method.
+ * @return      <code>TRUE</code> if the method is pure, <code>FALSE</code>
+ *              otherwise.
+ */
+static int check_purity(Body *b)
+{
+	int i;
+	unsigned int k, desc;
+	Body *copy;
+	Code *c;
+
+	if (b->idprop == NULL || strcmp(b->name, "main") == 0) {
+		return FALSE;
+	}
+	for (k = 0; k < b->idprop->nparams; k++) {
+		if (IS_ARRAY(b->idprop->params[k])) {
+			return FALSE;
+		}
+	}
+
+	c = b->code;
+	desc = b->desc;
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) != CODE_INSTRUCTION) {
+			continue;
+		}
+		switch (c[i].code) {
+			case JVM_GETSTATIC:
+			case JVM_INVOKEVIRTUAL:
+			case JVM_IASTORE:
+			case JVM_BASTORE:
+				return FALSE;
+			case JVM_INVOKESTATIC:
+				if (c[i + 1].str != desc &&
+				    ht_search(pure, strings[c[i + 1].str]) == NULL) {
+					return FALSE;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* keep a copy of the body for the compile-time interpreter; in streaming
+	 * mode, only the code of a small body is kept, and calls to the others
+	 * are left to run time
+	 */
+	copy = arena_alloc(sizeof(Body));
+	*copy = *b;
+	if ((options & OPT_STREAM) && !is_small(b)) {
+		copy->code = NULL;
+		copy->ip = 0;
+	} else {
+		copy->code = arena_alloc(b->ip * sizeof(Code));
+		memcpy(copy->code, b->code, b->ip * sizeof(Code));
+	}
+	if (ht_insert(pure, strings[desc], copy) != EXIT_SUCCESS) {
+		eprintf("Could not record pure method");
+	}
+	stats.pure++;
+	return TRUE;
+}
+
+/**
+ * Returns whether the code of a body fits the inlining budget, counting every
+ * element of the code, so that the cases of a switch count as well.  In
+ * streaming mode, only the code of such a body is kept once it is written.
+ *
+ * @param[in] b the body of the method.
+ * @return      <code>TRUE</code> if the body is small, <code>FALSE</code>
+ *              otherwise.
+ */
+static int is_small(Body *b)
+{
+	return b->ip <= 2 * inline_budget;
+}
+
+/**
+ * Builds the static call graph of the program from the
+ * <code>invokestatic</code> instructions of the bodies, and removes the bodies
+ * of subroutines that cannot be reached from <code>main</code>, so that they
+ * are neither written nor loaded and verified.  Calls that were inlined or
+ * evaluated at compile time no longer count as edges.  If no remaining body
+ * reads input, the input runtime is dropped as well.
+ */
+static void prune_call_graph(void)
+{
+	int i, n, top, reads;
+	Body *b, *next, **stack;
+	HashTab *methods;
+	Code *c;
+
+	methods = ht_init(0.75f, shift_hash, key_strcmp);
+	if (methods == NULL) {
+		eprintf("Call graph could not be initialised");
+	}
+
+	/* main is never called, and has no descriptor of its own */
+	for (n = 0, b = bodies; b; b = b->next, n++) {
+		if (b->idprop == NULL) {
+			continue;
+		}
+		if (ht_insert(methods, strings[b->desc], b) != EXIT_SUCCESS) {
+			eprintf("Could not record method in call graph");
+		}
+	}
+	for (b = bodies; b; b = b->next) {
+		link_callees(b, methods);
+	}
+	ht_free(methods, NULL, NULL);
+
+	/* mark everything reachable from main */
+	stack = emalloc((n + 1) * sizeof(Body *));
+	top = 0;
+	for (b = bodies; b; b = b->next) {
+		if (b->idprop == NULL || strcmp(b->name, "main") == 0) {
+			b->reachable = TRUE;
+			stack[top++] = b;
+		}
+	}
+	while (top > 0) {
+		b = stack[--top];
+		for (i = 0; i < b->ncallees; i++) {
+			if (!b->callees[i]->reachable) {
+				b->callees[i]->reachable = TRUE;
+				stack[top++] = b->callees[i];
+			}
+		}
+	}
+	free(stack);
+
+	/* unlink the rest, and count the callers of what remains */
+	reads = FALSE;
+	for (b = bodies; b; b = next) {
+		next = b->next;
+		if (!b->reachable) {
+			if (b->prev != NULL) {
+				b->prev->next = b->next;
+			} else {
+				bodies = b->next;
+			}
+			if (b->next != NULL) {
+				b->next->prev = b->prev;
+			}
+			stats.dead_methods++;
+			continue;
+		}
+		for (i = 0; i < b->ncallees; i++) {
+			b->callees[i]->fan_in++;
+		}
+		for (c = b->code, i = 0; i < b->ip; i++) {
+			if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+			    c[i].code == JVM_INVOKESTATIC &&
+			    (strcmp(strings[c[i + 1].str], ref_read_boolean) == 0 ||
+			     strcmp(strings[c[i + 1].str], ref_read_integer) == 0)) {
+				reads = TRUE;
+			}
+		}
+	}
+	uses_input = reads;
+}
+
+/**
+ * Records the distinct subroutines that a body calls, as the edges of the
+ * call graph.
+ *
+ * @param[in] b       the body of the method.
+ * @param[in] methods the bodies of the program by method descriptor.
+ */
+static void link_callees(Body *b, HashTab *methods)
+{
+	int i, k;
+	Body *callee;
+
+	b->callees = arena_alloc((b->ip + 1) * sizeof(Body *));
+	for (i = 0; i < b->ip; i++) {
+		if ((b->code[i].type & MASK_TYPE) != CODE_INSTRUCTION ||
+		    b->code[i].code != JVM_INVOKESTATIC) {
+			continue;
+		}
+		callee = ht_search(methods, strings[b->code[i + 1].str]);
+		if (callee == NULL) {
+			continue;
+		}
+		for (k = 0; k < b->ncallees && b->callees[k] != callee; k++)
+			;
+		if (k == b->ncallees) {
+			b->callees[b->ncallees++] = callee;
+		}
+	}
+}
+
+#define MIN_SWITCH_CASES 3
+
+/**
+ * Replaces each chain of tests of one local variable against constants, as
+ * generated for <code>if x = 1: ... elif x = 2: ... end</code>, by a single
+ * <code>tableswitch</code> or <code>lookupswitch</code>.  A test may only
+ * join the chain if it directly follows the label that the previous test
+ * branches to, if no other branch refers to that label, and if the code
+ * before the label cannot fall through into it.  The switch form is chosen
+ * as <code>javac</code> does, by weighing the size of the table against the
+ * time of the search.  The tests and labels that the switch makes redundant
+ * are left for the dead-code pass to remove.
+ *
+ * @param[in] b the body of the method; its code must be the code array.
+ */
+static void lower_switches(Body *b)
+{
+	int i, k, m, n, q, t, lo, hi, start, slot, v, key, ncases, size;
+	int *def, *refs;
+	long long range, table_cost, lookup_cost;
+	SwitchCase *cases, *sorted;
+	Label dflt;
+	Code *c, *out;
+
+	label_range(b, &lo, &hi);
+	if (hi == 0) {
+		return;
+	}
+
+	for (start = 0; start < b->ip; start = i + 1) {
+
+		/* locate the definition and count the references of each label */
+		c = b->code;
+		label_range(b, &lo, &hi);
+		def = emalloc((hi - lo + 1) * sizeof(int));
+		refs = emalloc((hi - lo + 1) * sizeof(int));
+		for (i = 0; i <= hi - lo; i++) {
+			def[i] = -1;
+			refs[i] = 0;
+		}
+		for (i = 0; i < b->ip; i++) {
+			if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+				def[c[i].label - lo] = i;
+			} else if ((c[i].type & MASK_TYPE) == (CODE_OPERAND | CODE_LABEL)) {
+				refs[c[i].label - lo]++;
+			}
+		}
+
+		/* find the next chain of enough tests of the same variable */
+		cases = emalloc((b->ip / 6 + 1) * sizeof(SwitchCase));
+		for (i = start, n = 0; i < b->ip; i++) {
+			if (!is_case_test(b, i, &slot, &key)) {
+				continue;
+			}
+			for (t = i, n = 0, ncases = 0;
+			     is_case_test(b, t, &v, &key) && v == slot; t = q + 1) {
+				cases[n].key = key;
+				cases[n].test = t;
+				cases[n].label = 1;
+				for (k = 0; k < n; k++) {
+					if (cases[k].label != 0 && cases[k].key == key) {
+						cases[n].label = 0;
+						break;
+					}
+				}
+				ncases += (cases[n++].label != 0);
+				q = def[c[t + 5].label - lo];
+				if (q <= t || refs[c[t + 5].label - lo] != 1 ||
+				    !((c[q - 1].type == CODE_INSTRUCTION &&
+				       ENDS_FLOW(c[q - 1].code)) ||
+				      (c[q - 2].type == CODE_INSTRUCTION &&
+				       c[q - 2].code == JVM_GOTO))) {
+					break;
+				}
+			}
+			if (ncases >= MIN_SWITCH_CASES) {
+				break;
+			}
+			n = 0;
+		}
+		if (n == 0) {
+			free(cases);
+			free(refs);
+			free(def);
+			break;
+		}
+		dflt = c[cases[n - 1].test + 5].label;
+		for (k = 0; k < n; k++) {
+			if (cases[k].label != 0) {
+				cases[k].label = get_label();
+			}
+		}
+
+		/* order the distinct keys, and weigh a table against a search */
+		sorted = emalloc(ncases * sizeof(SwitchCase));
+		for (k = m = 0; k < n; k++) {
+			if (cases[k].label != 0) {
+				sorted[m++] = cases[k];
+			}
+		}
+		qsort(sorted, ncases, sizeof(SwitchCase), cmp_case_key);
+		range = (long long) sorted[ncases - 1].key - sorted[0].key + 1;
+		table_cost = 4 + range + 3 * 3;
+		lookup_cost = 3 + 2 * (long long) ncases + 3 * (long long) ncases;
+
+		size = b->ip + 4 + ((table_cost <= lookup_cost) ? (int) range
+		                                                : 2 * ncases);
+		out = emalloc(size * sizeof(Code));
+
+		/* the code before the chain, and the load of the variable */
+		memcpy(out, c, i * sizeof(Code));
+		m = i;
+		out[m].type = CODE_INSTRUCTION;
+		out[m++].code = JVM_ILOAD;
+		out[m].type = CODE_OPERAND | CODE_INTEGER;
+		out[m++].num = slot;
+
+		/* the switch itself */
+		out[m].type = CODE_INSTRUCTION;
+		if (table_cost <= lookup_cost) {
+			out[m++].code = JVM_TABLESWITCH;
+			out[m].type = CODE_OPERAND | CODE_INTEGER;
+			out[m++].num = sorted[0].key;
+			out[m].type = CODE_OPERAND | CODE_INTEGER;
+			out[m++].num = sorted[ncases - 1].key;
+			for (k = 0; k < ncases; k++) {
+				for (; m - i - 5 < sorted[k].key - sorted[0].key; m++) {
+					out[m].type = CODE_OPERAND | CODE_LABEL;
+					out[m].label = dflt;
+				}
+				out[m].type = CODE_OPERAND | CODE_LABEL;
+				out[m++].label = sorted[k].label;
+			}
+		} else {
+			out[m++].code = JVM_LOOKUPSWITCH;
+			for (k = 0; k < ncases; k++) {
+				out[m].type = CODE_OPERAND | CODE_INTEGER;
+				out[m++].num = sorted[k].key;
+				out[m].type = CODE_OPERAND | CODE_LABEL;
+				out[m++].label = sorted[k].label;
+			}
+		}
+		out[m].type = CODE_OPERAND | CODE_LABEL;
+		out[m++].label = dflt;
+
+		/* each case starts at its own label, in place of its test; the body
+		 * of a repeated key cannot be reached any longer
+		 */
+		for (k = 0; k < n; k++) {
+			if (cases[k].label != 0) {
+				out[m].type = CODE_LABEL;
+				out[m++].label = cases[k].label;
+			}
+			t = cases[k].test + 6;
+			q = (k + 1 < n) ? cases[k + 1].test - 1 : b->ip;
+			memcpy(out + m, c + t, (q - t) * sizeof(Code));
+			m += q - t;
+		}
+
+		replace_code(b, out, m);
+		stats.switches++;
+
+		free(out);
+		free(sorted);
+		free(cases);
+		free(refs);
+		free(def);
+	}
+}
+
+/**
+ * Checks whether the code at the specified index compares a local variable
+ * with a constant, and branches if the two differ, that is, whether it is
+ * <code>iload x; ldc k; if_icmpne L</code>, or the same with the operands
+ * swapped.
+ *
+ * @param[in]  b    the body of the method.
+ * @param[in]  i    the index into the code array.
+ * @param[out] slot the local variable slot of <code>x</code>.
+ * @param[out] key  the constant <code>k</code>.
+ * @return          <code>TRUE</code> if the code is such a test,
+ *                  <code>FALSE</code> otherwise.
+ */
+static int is_case_test(Body *b, int i, int *slot, int *key)
+{
+	int v;
+	Code *c;
+
+	c = b->code;
+	if (i + 6 > b->ip || c[i].type != CODE_INSTRUCTION ||
+	    c[i + 2].type != CODE_INSTRUCTION ||
+	    c[i + 4].type != CODE_INSTRUCTION || c[i + 4].code != JVM_IF_ICMPNE) {
+		return FALSE;
+	}
+	for (v = 0; v <= 2; v += 2) {
+		if (c[i + v].code == JVM_ILOAD && c[i + 2 - v].code == JVM_LDC &&
+		    c[i + 3 - v].type == (CODE_OPERAND | CODE_INTEGER)) {
+			*slot = c[i + v + 1].num;
+			*key = c[i + 3 - v].num;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Compares two switch cases by key.
+ */
+static int cmp_case_key(const void *p, const void *q)
+{
+	const SwitchCase *a = p, *b = q;
+
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+/**
+ * Removes the instructions that cannot be reached from the method entry, for
+ * example, those that follow a return or an unconditional jump, as well as
+ * the labels that are no longer the target of any branch.
+ *
+ * @param[in] b the body of the method.
+ */
+static void eliminate_dead_code(Body *b)
+{
+	int i, j, w, n, lo, hi, *target, *work;
+	char *live;
+	Code *c;
+
+	c = b->code;
+	if (b->ip == 0) {
+		return;
+	}
+
+	/* map every label in this body to the index of its definition */
+	label_range(b, &lo, &hi);
+	target = emalloc((hi - lo + 1) * sizeof(int));
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			target[c[i].label - lo] = i;
+		}
+	}
+
+	/* mark live code by following fall-through and branch edges */
+	live = emalloc(b->ip);
+	memset(live, 0, b->ip);
+	work = emalloc((b->ip + 1) * sizeof(int));
+	n = 0;
+	work[n++] = 0;
+	while (n > 0) {
+		i = work[--n];
+		while (i < b->ip && !live[i]) {
+			live[i] = TRUE;
+			if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+				i++;
+				continue;
+			}
+			w = instr_width(b, i);
+			for (j = 1; j < w; j++) {
+				live[i + j] = TRUE;
+				if ((c[i + j].type & MASK_TYPE) ==
+				    (CODE_OPERAND | CODE_LABEL)) {
+					work[n++] = target[c[i + j].label - lo];
+				}
+			}
+			if (ENDS_FLOW(c[i].code)) {
+				break;
+			}
+			i += w;
+		}
+	}
+
+	/* drop dead code, then labels that only dead branches referred to */
+	for (i = j = 0; i < b->ip; i++) {
+		if (live[i]) {
+			c[j++] = c[i];
+		} else if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION) {
+			stats.dead_code++;
+		}
+	}
+	b->ip = j;
+
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == (CODE_OPERAND | CODE_LABEL)) {
+			target[c[i].label - lo] = -1;
+		}
+	}
+	for (i = j = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) != CODE_LABEL ||
+		    target[c[i].label - lo] == -1) {
+			c[j++] = c[i];
+		}
+	}
+	b->ip = j;
+
+	free(work);
+	free(live);
+	free(target);
+}
+
+#define MAX_JUMP_HOPS 16
+
+/**
+ * Simplifies the control flow of a body.  Runs of adjacent labels are merged
+ * into the first label of the run, branches to an unconditional goto are
+ * retargeted to the final destination of the goto chain, and gotos to the
+ * immediately following instruction are removed.  Labels and gotos that
+ * become unused are left for the dead-code pass to remove.
+ *
+ * @param[in] b the body of the method.
+ */
+static void thread_jumps(Body *b)
+{
+	int i, j, k, lo, hi, hops, *def, *alias;
+	Label l, m;
+	Code *c;
+
+	c = b->code;
+	label_range(b, &lo, &hi);
+	if (hi == 0) {
+		return;
+	}
+
+	def = emalloc((hi - lo + 1) * sizeof(int));
+	alias = emalloc((hi - lo + 1) * sizeof(int));
+	for (i = 0; i <= hi - lo; i++) {
+		def[i] = -1;
+		alias[i] = lo + i;
+	}
+
+	/* merge each run of adjacent labels into the first label of the run */
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			def[c[i].label - lo] = i;
+			if (i > 0 && (c[i - 1].type & MASK_TYPE) == CODE_LABEL) {
+				alias[c[i].label - lo] = alias[c[i - 1].label - lo];
+				stats.labels_merged++;
+			}
+		}
+	}
+
+	/* retarget branches, following chains of gotos */
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) != (CODE_OPERAND | CODE_LABEL)) {
+			continue;
+		}
+		l = alias[c[i].label - lo];
+		for (hops = 0; hops < MAX_JUMP_HOPS; hops++) {
+			k = def[l - lo];
+			while (k >= 0 && k < b->ip &&
+			       (c[k].type & MASK_TYPE) == CODE_LABEL) {
+				k++;
+			}
+			if (k < 0 || k >= b->ip ||
+			    (c[k].type & MASK_TYPE) != CODE_INSTRUCTION ||
+			    c[k].code != JVM_GOTO) {
+				break;
+			}
+			m = alias[c[k + 1].label - lo];
+			if (m == l) {
+				break;
+			}
+			l = m;
+		}
+		if (hops > 0) {
+			stats.jumps_threaded++;
+		}
+		c[i].label = l;
+	}
+
+	/* remove gotos to the immediately following instruction */
+	for (i = j = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    c[i].code == JVM_GOTO) {
+			l = c[i + 1].label;
+			for (k = i + 2; k < b->ip && (c[k].type & MASK_TYPE) == CODE_LABEL;
+			     k++) {
+				if (alias[c[k].label - lo] == l) {
+					break;
+				}
+			}
+			if (k < b->ip && (c[k].type & MASK_TYPE) == CODE_LABEL) {
+				stats.jumps_removed++;
+				i++;
+				continue;
+			}
+		}
+		c[j++] = c[i];
+	}
+	b->ip = j;
+
+	free(alias);
+	free(def);
+}
+
+#define WORD_BITS        (8 * sizeof(unsigned long))
+#define SET_BIT(s, n)    ((s)[(n) / WORD_BITS] |= 1UL << ((n) % WORD_BITS))
+#define CLEAR_BIT(s, n)  ((s)[(n) / WORD_BITS] &= ~(1UL << ((n) % WORD_BITS)))
+#define TEST_BIT(s, n)   (((s)[(n) / WORD_BITS] >> ((n) % WORD_BITS)) & 1UL)
+
+#define VAR_UNUSED 0
+#define VAR_SCALAR 1
+#define VAR_ARRAY  2
+
+/**
+ * Computes the live ranges of the scalar local variables of a body and packs
+ * variables whose live ranges do not overlap into shared local variable
+ * slots.  The slots of the parameters (and of the argument array of
+ * <code>main</code>) stay fixed, arrays each keep a slot of their own, and the
+ * width of the local variable array is reduced accordingly.
+ *
+ * @param[in] b the body of the method.
+ */
+static void pack_locals(Body *b)
+{
+	int i, k, v, u, n, lo, hi, nvars, nwords, nfixed, width, changed;
+	int *def, *color, *succ;
+	unsigned long *live, *out, *clash;
+	char *kind, *taken;
+	Code *c;
+
+	c = b->code;
+	nfixed = fixed_slots(b);
+
+	/* classify the local variables by the instructions that access them */
+	nvars = b->variables_width;
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_LOCAL_ACCESS(c[i].code) && c[i + 1].num >= nvars) {
+			nvars = c[i + 1].num + 1;
+		}
+	}
+	if (nvars <= nfixed) {
+		return;
+	}
+	kind = emalloc(nvars);
+	memset(kind, VAR_UNUSED, nvars);
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) != CODE_INSTRUCTION) {
+			continue;
+		}
+		if (c[i].code == JVM_ALOAD || c[i].code == JVM_ASTORE) {
+			kind[c[i + 1].num] = VAR_ARRAY;
+		} else if ((c[i].code == JVM_ILOAD || c[i].code == JVM_ISTORE ||
+		            c[i].code == JVM_IINC) &&
+		           kind[c[i + 1].num] == VAR_UNUSED) {
+			kind[c[i + 1].num] = VAR_SCALAR;
+		}
+	}
+
+	/* find the successor elements of each element */
+	label_range(b, &lo, &hi);
+	def = emalloc((hi - lo + 1) * sizeof(int));
+	for (i = 0; i <= hi - lo; i++) {
+		def[i] = -1;
+	}
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			def[c[i].label - lo] = i;
+		}
+	}
+	succ = emalloc(2 * b->ip * sizeof(int));
+	for (i = 0; i < b->ip; i++) {
+		succ[2 * i] = succ[2 * i + 1] = -1;
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			succ[2 * i] = i + 1;
+		} else if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION) {
+			if (!ENDS_FLOW(c[i].code)) {
+				succ[2 * i] = i + instr_width(b, i);
+			}
+			if (IS_BRANCH(c[i].code)) {
+				succ[2 * i + 1] = def[c[i + 1].label - lo];
+			}
+		}
+		for (k = 2 * i; k <= 2 * i + 1; k++) {
+			if (succ[k] < 0 || succ[k] >= b->ip) {
+				succ[k] = -1;
+			}
+		}
+	}
+
+	/* solve the backward liveness equations to a fixed point */
+	nwords = (nvars + WORD_BITS - 1) / WORD_BITS;
+	live = emalloc(b->ip * nwords * sizeof(unsigned long));
+	memset(live, 0, b->ip * nwords * sizeof(unsigned long));
+	out = emalloc(nwords * sizeof(unsigned long));
+	do {
+		changed = FALSE;
+		for (i = b->ip - 1; i >= 0; i--) {
+			if ((c[i].type & MASK_TYPE) == CODE_OPERAND ||
+			    (c[i].type & MASK_TYPE) == (CODE_OPERAND | CODE_LABEL)) {
+				continue;
+			}
+			memset(out, 0, nwords * sizeof(unsigned long));
+			for (k = 2 * i; k <= 2 * i + 1; k++) {
+				if (succ[k] >= 0) {
+					for (n = 0; n < nwords; n++) {
+						out[n] |= live[succ[k] * nwords + n];
+					}
+				}
+			}
+			if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+			    IS_SWITCH(c[i].code)) {
+				/* a switch has a successor for every case */
+				for (k = i + 1; k < i + instr_width(b, i); k++) {
+					if ((c[k].type & MASK_TYPE) !=
+					    (CODE_OPERAND | CODE_LABEL)) {
+						continue;
+					}
+					for (n = 0; n < nwords; n++) {
+						out[n] |= live[def[c[k].label - lo] * nwords + n];
+					}
+				}
+			}
+			if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION) {
+				if (c[i].code == JVM_ISTORE) {
+					CLEAR_BIT(out, c[i + 1].num);
+				} else if (c[i].code == JVM_ILOAD || c[i].code == JVM_IINC) {
+					SET_BIT(out, c[i + 1].num);
+				}
+			}
+			for (n = 0; n < nwords; n++) {
+				if (out[n] != live[i * nwords + n]) {
+					live[i * nwords + n] = out[n];
+					changed = TRUE;
+				}
+			}
+		}
+	} while (changed);
+
+	/* a store or increment interferes with every other variable live after
+	 * it
+	 */
+	clash = emalloc(nvars * nwords * sizeof(unsigned long));
+	memset(clash, 0, nvars * nwords * sizeof(unsigned long));
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) != CODE_INSTRUCTION ||
+		    (c[i].code != JVM_ISTORE && c[i].code != JVM_IINC)) {
+			continue;
+		}
+		v = c[i + 1].num;
+		for (k = 2 * i; k <= 2 * i + 1; k++) {
+			if (succ[k] < 0) {
+				continue;
+			}
+			for (u = 0; u < nvars; u++) {
+				if (u != v && TEST_BIT(&live[succ[k] * nwords], u)) {
+					SET_BIT(&clash[v * nwords], u);
+					SET_BIT(&clash[u * nwords], v);
+				}
+			}
+		}
+	}
+	for (v = 0; v < nvars; v++) {
+		for (u = 0; u < nvars; u++) {
+			if (u != v && (v < nfixed || TEST_BIT(live, v)) &&
+			    (u < nfixed || TEST_BIT(live, u))) {
+				SET_BIT(&clash[v * nwords], u);
+			}
+		}
 	}
 
-	dump_code(obj_file);
+	/* greedily colour the scalars, then give each array a slot of its own */
+	color = emalloc(nvars * sizeof(int));
+	taken = emalloc(nvars);
+	width = nfixed;
+	for (v = 0; v < nvars; v++) {
+		color[v] = (v < nfixed) ? v : -1;
+	}
+	for (v = nfixed; v < nvars; v++) {
+		if (kind[v] != VAR_SCALAR) {
+			continue;
+		}
+		memset(taken, FALSE, nvars);
+		for (u = 0; u < nvars; u++) {
+			if (color[u] >= 0 && TEST_BIT(&clash[v * nwords], u)) {
+				taken[color[u]] = TRUE;
+			}
+		}
+		for (k = nfixed; taken[k]; k++)
+			;
+		color[v] = k;
+		if (k + 1 > width) {
+			width = k + 1;
+		}
+	}
+	for (v = nfixed; v < nvars; v++) {
+		if (kind[v] == VAR_ARRAY) {
+			color[v] = width++;
+		}
+	}
 
-	fclose(obj_file);
+	/* rewrite the local variable operands */
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_LOCAL_ACCESS(c[i].code)) {
+			c[i + 1].num = color[c[i + 1].num];
+		}
+	}
+	if (width < b->variables_width) {
+		stats.slots_saved += b->variables_width - width;
+	}
+	b->variables_width = width;
+
+	free(taken);
+	free(color);
+	free(clash);
+	free(out);
+	free(live);
+	free(succ);
+	free(def);
+	free(kind);
 }
 
-/* --- utility functions ---------------------------------------------------- */
+#define MAX_LOOP_DEPTH 10
 
-static void ensure_space(int num_instr)
+/**
+ * Compares two slot uses by decreasing weight, breaking ties by slot number so
+ * that the order is deterministic.
+ */
+static int cmp_slot_use(const void *p, const void *q)
 {
-	if (ip + num_instr > code_size) {
-		code = erealloc(code, code_size * 2 * sizeof(Code));
-		code_size *= 2;
+	const SlotUse *a = p, *b = q;
+
+	if (a->weight != b->weight) {
+		return (a->weight < b->weight) ? 1 : -1;
 	}
+	return a->slot - b->slot;
 }
 
 /**
- * Computes the net change in the stack depth caused by the instruction, and
- * updates the maximum stack depth if necessary.
+ * Renumbers the local variables of a body so that the most frequently
+ * accessed variables occupy the lowest slots, which have compact load and
+ * store encodings.  Each static access counts for 8^d, where d is the depth
+ * of loop nesting at the access.  Parameter slots stay fixed.  The number of
+ * bytecode bytes saved, relative to the declaration order, is recorded in the
+ * body.
  *
- * @param[in] instr the instruction for which to factor in the stack effect.
+ * @param[in] b the body of the method.
  */
-static void adjust_stack(BC *instr)
+static void assign_hot_slots(Body *b)
 {
-	stack_depth += instr->push;
-	if (stack_depth > max_stack_depth) {
-		max_stack_depth = stack_depth;
+	int i, nvars, nfixed, lo, hi, depth, t, before, after;
+	int *def, *diff, *map;
+	SlotUse *use;
+	Code *c;
+
+	c = b->code;
+	nfixed = fixed_slots(b);
+	nvars = b->variables_width;
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_LOCAL_ACCESS(c[i].code) && c[i + 1].num >= nvars) {
+			nvars = c[i + 1].num + 1;
+		}
 	}
-	stack_depth -= instr->pop;
+	if (nvars <= nfixed + 1) {
+		return;
+	}
+
+	/* every backward branch closes a loop that spans its target to itself */
+	label_range(b, &lo, &hi);
+	def = emalloc((hi - lo + 1) * sizeof(int));
+	for (i = 0; i <= hi - lo; i++) {
+		def[i] = -1;
+	}
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_LABEL) {
+			def[c[i].label - lo] = i;
+		}
+	}
+	diff = emalloc((b->ip + 1) * sizeof(int));
+	memset(diff, 0, (b->ip + 1) * sizeof(int));
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_BRANCH(c[i].code)) {
+			t = def[c[i + 1].label - lo];
+			if (t >= 0 && t <= i) {
+				diff[t]++;
+				diff[i + 1]--;
+			}
+		}
+	}
+
+	/* weigh the accesses to each slot by loop depth */
+	use = emalloc(nvars * sizeof(SlotUse));
+	for (i = 0; i < nvars; i++) {
+		use[i].weight = 0;
+		use[i].slot = i;
+	}
+	depth = 0;
+	for (i = 0; i < b->ip; i++) {
+		depth += diff[i];
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_LOCAL_ACCESS(c[i].code)) {
+			use[c[i + 1].num].weight +=
+			    1UL << (3 * (depth < MAX_LOOP_DEPTH ? depth : MAX_LOOP_DEPTH));
+		}
+	}
+
+	/* hand out the free slots in order of decreasing weight */
+	qsort(use + nfixed, nvars - nfixed, sizeof(SlotUse), cmp_slot_use);
+	map = emalloc(nvars * sizeof(int));
+	for (i = 0; i < nvars; i++) {
+		map[use[i].slot] = i;
+	}
+
+	before = after = 0;
+	for (i = 0; i < b->ip; i++) {
+		if ((c[i].type & MASK_TYPE) == CODE_INSTRUCTION &&
+		    IS_LOCAL_ACCESS(c[i].code)) {
+			before += local_access_size(c[i].code, c[i + 1].num);
+			c[i + 1].num = map[c[i + 1].num];
+			after += local_access_size(c[i].code, c[i + 1].num);
+		}
+	}
+	b->bytes_saved = before - after;
+
+	free(map);
+	free(use);
+	free(diff);
+	free(def);
 }
 
 /**
- * Writes a method to the Jasmin output file.
+ * Writes a method to the Jasmin output buffer.
  *
- * @param[in] file the output file.
- * @param[in] b    the body of the method
+ * @param[in] buf the output buffer.
+ * @param[in] b   the body of the method
  */
-static void dump_method(FILE *file, Body *b)
+static void dump_method(Buffer *buf, Body *b)
 {
 	int i;
-	unsigned int k;
+
+	if (b->memo >= 0) {
+		dump_memo(buf, b);
+	}
 
 	if (strcmp(b->name, "main") == 0) {
 
-		fprintf(file, ".method public static main([Ljava/lang/String;)V\n");
+		buf_puts(buf, ".method public static main([Ljava/lang/String;)V\n");
 
 	} else {
 
-		fprintf(file, ".method public static %s(", b->name);
-		for (k = 0; k < b->idprop->nparams; k++) {
-			if (IS_ARRAY(b->idprop->params[k])) {
-				fputs("[", file);
-			}
-			fputs("I", file);
+		buf_puts(buf, ".method public static ");
+		buf_puts(buf, b->name);
+		if (b->memo >= 0) {
+			buf_puts(buf, "$body");
 		}
-		fprintf(file, ")%s%s\n", (IS_ARRAY_TYPE(b->idprop->type) ? "[" : ""),
-		        (b->idprop->type == TYPE_CALLABLE ? "V" : "I"));
+		dump_signature(buf, b);
 	}
-	fprintf(file, ".limit stack %d\n", b->max_stack_depth);
-	fprintf(file, ".limit locals %d\n", b->variables_width);
+	buf_puts(buf, ".limit stack ");
+	buf_putint(buf, b->max_stack_depth);
+	buf_puts(buf, "\n.limit locals ");
+	buf_putint(buf, b->variables_width);
+	buf_put(buf, "\n", 1);
 
 	for (i = 0; i < b->ip; i++) {
 
@@ -616,50 +3939,61 @@ static void dump_method(FILE *file, Body *b)
 
 		switch (c.type & MASK_TYPE) {
 			case CODE_LABEL:
-				fprintf(file, "L%d:\n", c.label);
+				buf_put(buf, "L", 1);
+				buf_putint(buf, c.label);
+				buf_put(buf, ":\n", 2);
 				break;
 			case CODE_LABEL | CODE_OPERAND:
-				fprintf(file, " L%d\n", c.label);
+				buf_put(buf, " L", 2);
+				buf_putint(buf, c.label);
+				buf_put(buf, "\n", 1);
 				break;
 			case CODE_INSTRUCTION:
-				fprintf(file, "\t%s", get_opcode_string(c.code));
-				switch (c.code) {
-					case JVM_ARETURN:
-					case JVM_IADD:
-					case JVM_IALOAD:
-					case JVM_IAND:
-					case JVM_IASTORE:
-					case JVM_IDIV:
-					case JVM_IMUL:
-					case JVM_INEG:
-					case JVM_IOR:
-					case JVM_ISUB:
-					case JVM_IREM:
-					case JVM_IRETURN:
-					case JVM_IXOR:
-					case JVM_RETURN:
-					case JVM_SWAP:
-						/* emit linefeed */
-						fprintf(file, "\n");
-						break;
-					default:
-						/* no linefeed */
-						break;
+				if ((unsigned long) c.code >= NBYTECODES) {
+					buf_puts(buf, "\tINVALID OPCODE\n");
+					break;
+				}
+				if (IS_SWITCH(c.code)) {
+					i = dump_switch(buf, b, i);
+					break;
+				}
+				buf_put(buf, "\t", 1);
+				buf_put(buf, instruction_set[c.code].instr, opcode_len[c.code]);
+				if (IS_LOCAL_ACCESS(c.code) && c.code != JVM_IINC &&
+				    b->code[i + 1].num < 4) {
+					/* use the compact encoding for the low slots */
+					buf_put(buf, "_", 1);
+					buf_putint(buf, b->code[++i].num);
+					buf_put(buf, "\n", 1);
+				} else if (instr_width(b, i) == 1) {
+					/* no operand follows, so emit linefeed */
+					buf_put(buf, "\n", 1);
 				}
 				break;
 			case CODE_OPERAND:
 				switch (c.type & MASK_DATA_TYPE) {
 					case CODE_ARRAY_TYPE:
-						fprintf(file, " %s\n", java_types[c.atype - T_BOOLEAN]);
+						buf_put(buf, " ", 1);
+						buf_puts(buf, java_types[c.atype - T_BOOLEAN]);
+						buf_put(buf, "\n", 1);
 						break;
 					case CODE_INTEGER:
-						fprintf(file, " %d\n", c.num);
+						buf_put(buf, " ", 1);
+						buf_putint(buf, c.num);
+						if (instr_width(b, i) == 1) {
+							/* no further operand follows */
+							buf_put(buf, "\n", 1);
+						}
 						break;
 					case CODE_REFERENCE:
-						fprintf(file, " %s\n", c.string);
+						buf_put(buf, " ", 1);
+						buf_puts(buf, strings[c.str]);
+						buf_put(buf, "\n", 1);
 						break;
 					case CODE_STRING:
-						fprintf(file, " \"%s\"\n", c.string);
+						buf_put(buf, " \"", 2);
+						buf_puts(buf, strings[c.str]);
+						buf_put(buf, "\"\n", 2);
 						break;
 					default:
 						weprintf("Unknown data type for bytecode: %x\n",
@@ -674,26 +4008,474 @@ static void dump_method(FILE *file, Body *b)
 
 	/* guard against a dangling label at the end of the code stream */
 	if ((b->code[b->ip-1].type & MASK_TYPE) == CODE_LABEL) {
-		fprintf(file, "\tnop\n");
+		buf_puts(buf, "\tnop\n");
 	}
 
-	fprintf(file, ".end method\n\n");
+	buf_puts(buf, ".end method\n\n");
 }
 
 /**
- * Writes the preamble to the Jasmin output file.  The preamble consists of (i)
- * the class name and visibility specifier, (ii) the superclass, and (iii) the
- * default initialiser (constructor).
+ * Writes the parameter and return types of a method, in the form of a method
+ * descriptor, to the Jasmin output buffer.
  *
- * @param[in] file the output file.
+ * @param[in] buf the output buffer.
+ * @param[in] b   the body of the method.
+ */
+static void dump_signature(Buffer *buf, Body *b)
+{
+	unsigned int k;
+	ValType t;
+
+	buf_put(buf, "(", 1);
+	for (k = 0; k < b->idprop->nparams; k++) {
+		t = b->idprop->params[k];
+		if (IS_ARRAY(t)) {
+			buf_put(buf, IS_BOOLEAN_TYPE(t) ? "[Z" : "[I", 2);
+		} else {
+			buf_put(buf, "I", 1);
+		}
+	}
+	buf_put(buf, ")", 1);
+	if (b->idprop->type == TYPE_CALLABLE) {
+		buf_put(buf, "V\n", 2);
+	} else if (IS_ARRAY_TYPE(b->idprop->type)) {
+		buf_put(buf, IS_BOOLEAN_TYPE(b->idprop->type) ? "[Z\n" : "[I\n", 3);
+	} else {
+		buf_put(buf, "I\n", 2);
+	}
+}
+
+/**
+ * Writes the memo wrapper of a memoised function to the Jasmin output buffer.
+ * The wrapper takes the name of the function, and calls the compiled body
+ * only for arguments it has not seen before.
+ *
+ * @param[in] buf the output buffer.
+ * @param[in] b   the body of the function.
+ */
+static void dump_memo(Buffer *buf, Body *b)
+{
+	unsigned int k;
+	const char *desc, *params;
+
+	buf_puts(buf, ".method public static ");
+	buf_puts(buf, b->name);
+	dump_signature(buf, b);
+	buf_puts(buf, memo_limits);
+
+	buf_puts(buf, (b->idprop->nparams == 1) ? memo_key_1 : memo_key_2);
+	buf_subst(buf, memo_map, class_name);
+	buf_puts(buf, "\tldc ");
+	buf_putint(buf, b->memo);
+	buf_put(buf, "\n", 1);
+	buf_puts(buf, memo_lookup);
+
+	for (k = 0; k < b->idprop->nparams; k++) {
+		buf_puts(buf, "\tiload ");
+		buf_putint(buf, PARAM_SLOT((int) k));
+		buf_put(buf, "\n", 1);
+	}
+	desc = strings[b->desc];
+	params = strchr(desc, '(');
+	buf_puts(buf, "\tinvokestatic ");
+	buf_put(buf, desc, params - desc);
+	buf_puts(buf, "$body");
+	buf_puts(buf, params);
+	buf_put(buf, "\n", 1);
+	buf_puts(buf, memo_store);
+}
+
+/**
+ * Writes a <code>tableswitch</code> or <code>lookupswitch</code>, with its
+ * operands, to the Jasmin output buffer.
+ *
+ * @param[in] buf the output buffer.
+ * @param[in] b   the body of the method.
+ * @param[in] i   the index of the switch in the code array.
+ * @return        the index of the last operand of the switch.
+ */
+static int dump_switch(Buffer *buf, Body *b, int i)
+{
+	int j, w;
+	Code *c;
+
+	c = b->code;
+	w = instr_width(b, i);
+	buf_put(buf, "\t", 1);
+	buf_put(buf, instruction_set[c[i].code].instr, opcode_len[c[i].code]);
+	j = i + 1;
+	if (c[i].code == JVM_TABLESWITCH) {
+		buf_put(buf, " ", 1);
+		buf_putint(buf, c[j++].num);
+		buf_put(buf, " ", 1);
+		buf_putint(buf, c[j++].num);
+	}
+	buf_put(buf, "\n", 1);
+
+	for (; j < i + w - 1; j++) {
+		buf_put(buf, "\t\t", 2);
+		if ((c[j].type & MASK_TYPE) == CODE_OPERAND) {
+			/* the key of a lookupswitch pair */
+			buf_putint(buf, c[j++].num);
+			buf_put(buf, " : ", 3);
+		}
+		buf_put(buf, "L", 1);
+		buf_putint(buf, c[j].label);
+		buf_put(buf, "\n", 1);
+	}
+	buf_puts(buf, "\t\tdefault : L");
+	buf_putint(buf, c[j].label);
+	buf_put(buf, "\n", 1);
+
+	return j;
+}
+
+/**
+ * Writes the preamble to the Jasmin output buffer.  The preamble consists of
+ * the class name and visibility specifier, the superclass, and the fields of
+ * the runtime support, followed, unless the methods are streamed, by the
+ * runtime support itself.
+ *
+ * @param[in] buf  the output buffer.
+ * @param[in] name the name of the class.
+ */
+static void dump_preamble(Buffer *buf, char *name)
+{
+	/* class header */
+	buf_subst(buf, class_header, name);
+	if (options & OPT_FAST_OUTPUT) {
+		buf_puts(buf, class_runnable);
+	}
+	buf_puts(buf, "\n");
+
+	/* fields, which must precede the methods; while streaming, it is not yet
+	 * known whether the input fields are needed, but declaring them is free
+	 */
+	if (uses_input || (options & OPT_STREAM)) {
+		buf_puts(buf, (options & OPT_FAST_INPUT) ? fields_fast_input
+		                                         : fields_scanner);
+	}
+	if (options & OPT_FAST_OUTPUT) {
+		buf_puts(buf, fields_fast_output);
+	}
+	if (nmemo > 0 || ((options & OPT_MEMOISE) && (options & OPT_STREAM))) {
+		buf_puts(buf, fields_memo);
+	}
+	if (uses_input || nmemo > 0 ||
+	    (options & (OPT_STREAM | OPT_FAST_OUTPUT))) {
+		buf_puts(buf, "\n");
+	}
+
+	if (!(options & OPT_STREAM)) {
+		dump_runtime(buf, name);
+	}
+}
+
+/**
+ * Writes the runtime support to the Jasmin output buffer: the static
+ * initialiser, the default initialiser (constructor), the input methods if
+ * the program reads input, and the buffered output methods if selected.  A
+ * program without input thus does not pay for setting up a Scanner when the
+ * class is loaded.
+ *
+ * @param[in] buf  the output buffer.
  * @param[in] name the name of the class.
  */
-static void dump_preamble(FILE *file, char *name)
+static void dump_runtime(Buffer *buf, char *name)
+{
+	/* static initialiser */
+	if (uses_input || nmemo > 0 || (options & OPT_FAST_OUTPUT)) {
+		buf_puts(buf, clinit_begin);
+		if (uses_input) {
+			buf_subst(buf, (options & OPT_FAST_INPUT) ? clinit_fast_input
+			                                          : clinit_scanner, name);
+		}
+		if (options & OPT_FAST_OUTPUT) {
+			buf_subst(buf, clinit_fast_output, name);
+		}
+		if (nmemo > 0) {
+			buf_puts(buf, "\tldc ");
+			buf_putint(buf, nmemo);
+			buf_put(buf, "\n", 1);
+			buf_subst(buf, clinit_memo, name);
+		}
+		buf_puts(buf, clinit_end);
+	}
+
+	/* constructor and runtime methods */
+	buf_puts(buf, method_init);
+	if (uses_input && (options & OPT_FAST_INPUT)) {
+		buf_subst(buf, method_readByte, name);
+		buf_subst(buf, method_readInt_fast, name);
+		buf_subst(buf, method_readBoolean_fast, name);
+		buf_subst(buf, method_matchRest, name);
+	} else if (uses_input) {
+		buf_subst(buf, method_readInt, name);
+		buf_subst(buf, method_readBoolean, name);
+	}
+	if (options & OPT_FAST_OUTPUT) {
+		buf_subst(buf, method_run, name);
+		buf_subst(buf, method_flushOut, name);
+		buf_subst(buf, method_printInt, name);
+		buf_subst(buf, method_printBoolean, name);
+		buf_subst(buf, method_printString, name);
+	}
+}
+
+/**
+ * Writes a method to the code file as soon as it is closed, opening the file
+ * and writing the preamble on the first call.
+ *
+ * @param[in] b the body of the method.
+ */
+static void stream_method(Body *b)
+{
+	if (stream_file == NULL) {
+		if ((stream_file = fopen(jasm_name, "w")) == NULL) {
+			eprintf("Could not open code file:");
+		}
+		buf_init(&stream_buf, BUFFER_SIZE);
+		dump_preamble(&stream_buf, class_name);
+	}
+
+	dump_method(&stream_buf, b);
+	if (stream_buf.len >= FLUSH_SIZE) {
+		buf_flush(&stream_buf, stream_file);
+	}
+}
+
+/**
+ * Serialises the methods into separate buffers on a pool of threads, and then
+ * writes the preamble and the buffers to the output file in the same order as
+ * the serial path, so that the output is identical.
+ *
+ * @param[in] file the output file.
+ */
+static void dump_code_parallel(FILE *file)
+{
+	int i, n, nthreads;
+	pthread_t *threads;
+	DumpJob job;
+	Body *b;
+
+	for (n = 0, b = bodies; b; b = b->next) {
+		n++;
+	}
+	job.methods = emalloc((n + 1) * sizeof(Body *));
+	job.bufs = emalloc((n + 1) * sizeof(Buffer));
+	for (i = 0, b = bodies; b; b = b->next) {
+		job.methods[i++] = b;
+	}
+	job.n = n;
+	job.next = 0;
+	pthread_mutex_init(&job.lock, NULL);
+
+	/* the preamble goes into the last buffer, and is written first */
+	buf_init(&job.bufs[n], BUFFER_SIZE);
+	dump_preamble(&job.bufs[n], class_name);
+
+	nthreads = (dump_threads < n) ? dump_threads : n;
+	threads = emalloc((nthreads + 1) * sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, dump_worker, &job) != 0) {
+			eprintf("Could not create a serialisation thread:");
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	write_buffers(file, &job.bufs[n], 1);
+	write_buffers(file, job.bufs, n);
+
+	for (i = 0; i <= n; i++) {
+		buf_free(&job.bufs[i]);
+	}
+	pthread_mutex_destroy(&job.lock);
+	free(threads);
+	free(job.bufs);
+	free(job.methods);
+}
+
+/**
+ * Serialises bodies of a dump job into their buffers until no bodies remain.
+ *
+ * @param[in] arg the dump job.
+ * @return        <code>NULL</code>.
+ */
+static void *dump_worker(void *arg)
+{
+	DumpJob *job = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+		if (i >= job->n) {
+			break;
+		}
+		buf_init(&job->bufs[i], 32 * (job->methods[i]->ip + 16));
+		dump_method(&job->bufs[i], job->methods[i]);
+	}
+
+	return NULL;
+}
+
+/**
+ * Writes a sequence of buffers to a file with gathering writes, bypassing the
+ * stdio buffer of the file, which is flushed first.
+ *
+ * @param[in] file the output file.
+ * @param[in] bufs the buffers to write, in order.
+ * @param[in] n    the number of buffers.
+ */
+static void write_buffers(FILE *file, Buffer *bufs, int n)
+{
+	struct iovec iov[IOV_BATCH], *v;
+	int i, k, fd;
+	ssize_t w;
+
+	fflush(file);
+	fd = fileno(file);
+	for (i = 0; i < n; i += k) {
+		for (k = 0; k < IOV_BATCH && i + k < n; k++) {
+			iov[k].iov_base = bufs[i + k].data;
+			iov[k].iov_len = bufs[i + k].len;
+		}
+		v = iov;
+		while (v < iov + k) {
+			if ((w = writev(fd, v, iov + k - v)) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				eprintf("Could not write code file:");
+			}
+			/* skip what was written, resuming partway into a buffer */
+			while (v < iov + k && (size_t) w >= v->iov_len) {
+				w -= v->iov_len;
+				v++;
+			}
+			if (v < iov + k) {
+				v->iov_base = (char *) v->iov_base + w;
+				v->iov_len -= w;
+			}
+		}
+	}
+}
+
+/**
+ * Initialises an empty output buffer.
+ *
+ * @param[out] buf  the buffer.
+ * @param[in]  size the initial capacity of the buffer.
+ */
+static void buf_init(Buffer *buf, size_t size)
+{
+	buf->data = emalloc(size);
+	buf->len = 0;
+	buf->size = size;
+}
+
+/**
+ * Appends characters to an output buffer, growing it if necessary.
+ *
+ * @param[in] buf the buffer.
+ * @param[in] s   the characters to append.
+ * @param[in] n   the number of characters to append.
+ */
+static void buf_put(Buffer *buf, const char *s, size_t n)
+{
+	if (buf->len + n > buf->size) {
+		while (buf->len + n > buf->size) {
+			buf->size *= 2;
+		}
+		buf->data = erealloc(buf->data, buf->size);
+	}
+	memcpy(buf->data + buf->len, s, n);
+	buf->len += n;
+}
+
+/**
+ * Appends a nul-terminated string to an output buffer.
+ *
+ * @param[in] buf the buffer.
+ * @param[in] s   the string to append.
+ */
+static void buf_puts(Buffer *buf, const char *s)
+{
+	buf_put(buf, s, strlen(s));
+}
+
+/**
+ * Appends the decimal representation of an integer to an output buffer.
+ *
+ * @param[in] buf the buffer.
+ * @param[in] n   the integer to append.
+ */
+static void buf_putint(Buffer *buf, int n)
+{
+	char digits[12], *p;
+	unsigned int u;
+
+	p = digits + sizeof(digits);
+	u = (n < 0) ? -(unsigned int) n : (unsigned int) n;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	if (n < 0) {
+		*--p = '-';
+	}
+	buf_put(buf, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * Appends a template to an output buffer, substituting a string for every
+ * occurrence of <code>%s</code> in the template.
+ *
+ * @param[in] buf  the buffer.
+ * @param[in] tmpl the template.
+ * @param[in] s    the string to substitute.
+ */
+static void buf_subst(Buffer *buf, const char *tmpl, const char *s)
+{
+	const char *p;
+	size_t slen;
+
+	slen = strlen(s);
+	while ((p = strstr(tmpl, "%s")) != NULL) {
+		buf_put(buf, tmpl, p - tmpl);
+		buf_put(buf, s, slen);
+		tmpl = p + 2;
+	}
+	buf_puts(buf, tmpl);
+}
+
+/**
+ * Writes the contents of an output buffer to a file and empties the buffer.
+ *
+ * @param[in] buf  the buffer.
+ * @param[in] file the output file.
+ */
+static void buf_flush(Buffer *buf, FILE *file)
 {
-	fprintf(file, class_preamble, name, name, name, name, name, name, name);
-	fputs(method_init, file);
-	fprintf(file, method_readInt, name);
-	fprintf(file, method_readBoolean, name);
+	if (buf->len > 0 && fwrite(buf->data, 1, buf->len, file) != buf->len) {
+		eprintf("Could not write code file:");
+	}
+	buf->len = 0;
+}
+
+/**
+ * Releases the memory of an output buffer.
+ *
+ * @param[in] buf the buffer.
+ */
+static void buf_free(Buffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
 }
 
 void release_code_generation(void)
@@ -704,9 +4486,27 @@ void release_code_generation(void)
 	unlink(jasm_name);
 #endif
 
-	/* free bodies */
-	/* TODO */
+	/* free bodies, their code, and the interned strings in one go */
+	ht_free(interned, NULL, NULL);
+	ht_free(descriptors, NULL, NULL);
+	ht_free(inlinable, NULL, NULL);
+	ht_free(pure, NULL, NULL);
+	arena_release();
+	bodies = NULL;
 
-	/* free strings */
-	/* TODO */
+	/* free the working arrays and strings */
+	free(code);
+	free(strings);
+	free(class_name);
+	free(jasm_name);
+	free(ref_read_boolean);
+	free(ref_read_integer);
+	free(ref_fast_print_boolean);
+	free(ref_fast_print_integer);
+	free(ref_fast_print_string);
+	free(ref_fast_flush);
+	free(pieces);
+	buf_free(&print_text);
+	code = NULL;
+	strings = NULL;
 }
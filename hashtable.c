@@ -281,6 +281,65 @@ void keyval2str(void *k, void *v, char *b)
 	snprintf(b, PRINT_BUFFER_SIZE, "%s:[%s]", key_str, value_str);
 }
 
+/**
+ * Hash a string key with a cyclic bit shift hash.  Every character affects the
+ * hash, however long the key, so that method descriptors sharing the class
+ * name as prefix still spread over the table.
+ *
+ * @param[in]  key
+ *     a pointer to the string key
+ * @param[in]  size
+ *     the size of the underlying table
+ * @return
+ *     the hash value of the key, or <code>0</code> if the key is
+ *     <code>NULL</code>
+ */
+unsigned int shift_hash(void *key, unsigned int size)
+{
+#ifdef DEBUG_SYMBOL_TABLE
+	char *keystr = (char *) key;
+	unsigned int i, hash, length;
+
+	hash = 0;
+	length = strlen(keystr);
+	for (i = 0; i < length; i++) {
+		hash += keystr[i];
+	}
+
+	return (hash % size);
+
+#else
+	char *str = (char *) key;
+	unsigned int hash = 0;
+
+	if (str == NULL) {
+		return 0;
+	}
+
+	while (*str) {
+		hash = (hash << 5 | hash >> 27) ^ (unsigned char) *str++;
+	}
+
+	return hash % size;
+#endif /* DEBUG_SYMBOL_TABLE */
+}
+
+/**
+ * Compare two string keys.
+ *
+ * @param[in]  val1
+ *     a pointer to the first key
+ * @param[in]  val2
+ *     a pointer to the second key
+ * @return
+ *     a negative value, zero, or a positive value if <code>val1</code> is less
+ *     than, equal to, or greater than <code>val2</code>, respectively
+ */
+int key_strcmp(void *val1, void *val2)
+{
+	return strcmp((char *) val1, (char *) val2);
+}
+
 /* --- utility functions -------------------------------------------------- */
 
 /**
@@ -351,19 +410,14 @@ static void rehash(HashTab *ht)
 	for (unsigned int i = 0; i < ht->size; i++) {
 		HTentry *current = ht->table[i];
 		while (current != NULL) {
+			HTentry *next = current->next_ptr;
 			unsigned int newHash = ht->hash(current->key, newSize);
 
-			HTentry *newEntry = malloc(sizeof(HTentry));
-			if (!newEntry) {
-				return;
-			}
-			newEntry->key = current->key;
-			newEntry->value = current->value;
-			newEntry->next_ptr = newTable[newHash];
-
-			newTable[newHash] = newEntry;
+			/* move the entry itself into the new table */
+			current->next_ptr = newTable[newHash];
+			newTable[newHash] = current;
 
-			current = current->next_ptr;
+			current = next;
 		}
 	}
 
@@ -32,8 +32,6 @@ static unsigned int saved_offset;
 
 static void valstr(void *key, void *p, char *str);
 static void freeprop(void *p);
-static unsigned int shift_hash(void *key, unsigned int size);
-static int key_strcmp(void *val1, void *val2);
 
 /* --- symbol table interface --------------------------------------------- */
 
@@ -79,7 +77,11 @@ Boolean open_subroutine(char *id, IDPropt *prop)
 	if (table == NULL) {
 		return FALSE;
 	}
-	curr_offset = 1;
+
+	/* a static method gets its parameters in the first slots, from 0; only
+	 * main reserves slot 0, for its argument array
+	 */
+	curr_offset = 0;
 	return TRUE;
 }
 
@@ -220,60 +222,10 @@ static void freeprop(void *p)
 	IDPropt *idpp = (IDPropt *) p;
 
 	if (idpp) {
-		if (IS_FUNCTION(idpp->type)) {
+		if (IS_CALLABLE_TYPE(idpp->type)) {
 			free(idpp->params);
 		}
 
 		free(idpp);
 	}
 }
-
-/**
- * @brief   Hash the key.
- * @param   key   the key
- * @param   size  the size of the hash table
- * @return  the hash value of the key
- */
-static unsigned int shift_hash(void *key, unsigned int size)
-{
-#ifdef DEBUG_SYMBOL_TABLE
-	char *keystr = (char *) key;
-	unsigned int i, hash, length;
-
-	hash = 0;
-	length = strlen(keystr);
-	for (i = 0; i < length; i++) {
-		hash += keystr[i];
-	}
-
-	return (hash % size);
-
-#else
-	char *str = (char *) key;
-	unsigned int hash = 0;
-
-	if (str == NULL) {
-		return 0;
-	}
-
-	while (*str) {
-		hash = (hash << 5) ^ (*str++);
-	}
-
-	return hash % size;
-#endif /* DEBUG_SYMBOL_TABLE */
-}
-
-/**
- * @brief   Compare two keys.
- * @param   val1  the first key
- * @param   val2  the second key
- * @return  the result of the comparison
- */
-static int key_strcmp(void *val1, void *val2)
-{
-	char *key1 = (char *) val1;
-	char *key2 = (char *) val2;
-
-	return strcmp(key1, key2);
-}
@@ -0,0 +1,891 @@
+/**
+ * @file    codegen_tests.c
+ * @brief   Table-driven tests of the code generator.  Each test generates a
+ *          small program through the interface the parser uses, and checks
+ *          that its Jasmin code contains the instructions the optimisation
+ *          under test must produce, and none of those it must remove.  If
+ *          JASMIN_JAR names the Jasmin jar, the class is also assembled and
+ *          run, and must print exactly the expected output.
+ */
+
+#include "codegen.h"
+
+#include "boolean.h"
+#include "error.h"
+#include "symboltable.h"
+#include "valtypes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FRAGMENTS 4
+
+typedef struct {
+	char *name;                   /**< the class name of the program      */
+	unsigned int options;         /**< the code generation options        */
+	void (*gen)(void);            /**< generates the program              */
+	char *output;                 /**< what the program must print        */
+	char *present[MAX_FRAGMENTS]; /**< code the listing must contain      */
+	char *absent[MAX_FRAGMENTS];  /**< code the listing must not contain  */
+} TestCase;
+
+/* --- function prototypes -------------------------------------------------*/
+
+static int run_test(TestCase *t);
+static char *read_file(const char *path);
+static IDPropt *declare(char *id, ValType type);
+static IDPropt *open_sub(char *id, ValType type, unsigned int nparams);
+static void close_sub(void);
+static void gen_true_guard(void);
+static void gen_false_guard(void);
+static void gen_fused_compare(void);
+static void gen_if_chain(void);
+static void gen_param_slots(void);
+static void gen_inline_max(void);
+static void gen_inline_nested(void);
+static void gen_tail_call(void);
+static void gen_evaluate_call(void);
+static void gen_print_order(void);
+static void gen_memo_threads(void);
+static void gen_fast_text(void);
+static void gen_constant_first(void);
+
+/* --- the tests ------------------------------------------------------------*/
+
+static TestCase tests[] = {
+	{"TrueGuard", 0, gen_true_guard, "1",
+	 {"ldc \"1\""},
+	 {"ifeq", "goto"}},
+	{"FalseGuard", 0, gen_false_guard, "2",
+	 {"ldc \"2\""},
+	 {"ifeq", "goto", "\"7\""}},
+	{"FusedCompare", 0, gen_fused_compare, "012",
+	 {"\tldc 3\n\tif_icmpge L"},
+	 {"ifeq", "if_icmplt"}},
+	{"IfChain", 0, gen_if_chain, "20",
+	 {"tableswitch 1 3"},
+	 {"if_icmp"}},
+	{"ParamSlots", 0, gen_param_slots, "10 3",
+	 {"\tiload_0\n\tldc 0\n\tif_icmpne", "\tiload_0\n\tiload_0\n\tldc 1",
+	  "\tiload_0\n\tiload_1\n\tisub\n\tistore_2"},
+	 {"iload_3"}},
+	{"PackedParamSlots", OPT_PACK_LOCALS, gen_param_slots, "10 3",
+	 {"\tiload_0\n\tldc 0\n\tif_icmpne", "\tiload_0\n\tiload_0\n\tldc 1",
+	  "\tiload_0\n\tiload_1\n\tisub\n\tistore_2"},
+	 {"iload_3"}},
+	{"InlineMax", 0, gen_inline_max, "7 6 5 4 4 5 6 7 ",
+	 {"\tisub\n\tistore_3\n\tistore_2\n\tiload_2\n\tiload_3\n\tif_icmple"},
+	 {"invokestatic InlineMax.max"}},
+	{"InlineNested", 0, gen_inline_nested, "12",
+	 {"\tistore_1\n\tiload_1\n\tiload_1\n\tiadd\n\tistore_2\n\tiload_2\n"
+	  "\tiload_2\n\tiadd\n\tgetstatic"},
+	 {"invokestatic InlineNested.twice", "invokestatic InlineNested.quad"}},
+	{"TailCall", 0, gen_tail_call, "21 42 63 84 ",
+	 {"\tirem\n\tistore_1\n\tistore_0\n\tgoto L"},
+	 {"invokestatic TailCall.gcd(II)I\n\tireturn"}},
+	{"EvaluateCall", 0, gen_evaluate_call, "65536 65536",
+	 {"ldc \"65536 \"", "invokestatic EvaluateCall.pow2(I)I"},
+	 {"ldc 16\n\tinvokestatic"}},
+	{"StreamedCall", OPT_STREAM, gen_evaluate_call, "65536 65536",
+	 {"ldc 16\n\tinvokestatic StreamedCall.pow2(I)I"},
+	 {"ldc \"65536 \""}},
+	{"MemoThreads", OPT_MEMOISE, gen_memo_threads, "6765",
+	 {"invokestatic MemoThreads.fib$body(I)I",
+	  ".method public static fib$body(I)I"},
+	 {NULL}},
+	{"FastText", OPT_FAST_OUTPUT, gen_fast_text, "n\xc3\xa9 5",
+	 {"invokevirtual java/lang/String/getBytes()[B"},
+	 {"charAt"}},
+	{"ConstantFirst", 0, gen_constant_first, "15 20",
+	 {"\tldc 3\n\tiload_1\n\timul", "\tiload_1\n\tldc 2\n\tishl"},
+	 {"\tiload_1\n\tldc 3\n\timul"}},
+	{"PrintOrder", 0, gen_print_order, "a<1>1b<2>2c",
+	 {"ldc \"a\"\n\tinvokevirtual java/io/PrintStream/print("
+	  "Ljava/lang/String;)V\n\tgetstatic"},
+	 {NULL}},
+};
+
+#define NTESTS (sizeof(tests) / sizeof(tests[0]))
+
+int main(void)
+{
+	unsigned int i;
+	int failed;
+
+	for (i = failed = 0; i < NTESTS; i++) {
+		if (!run_test(&tests[i])) {
+			failed++;
+		}
+	}
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- test driver ----------------------------------------------------------*/
+
+/**
+ * Runs one test, and reports on standard error what it finds wrong.
+ *
+ * @param[in] t the test.
+ * @return      <code>TRUE</code> if the test passed, <code>FALSE</code>
+ *              otherwise.
+ */
+static int run_test(TestCase *t)
+{
+	char path[128], *listing, *jar, *output;
+	int i, ok;
+
+	init_symbol_table();
+	init_code_generation();
+	set_codegen_options(t->options);
+	set_class_name(t->name);
+	t->gen();
+	make_code_file();
+
+	ok = TRUE;
+	snprintf(path, sizeof(path), "%s.jasmin", t->name);
+	listing = read_file(path);
+	for (i = 0; i < MAX_FRAGMENTS; i++) {
+		if (t->present[i] != NULL && strstr(listing, t->present[i]) == NULL) {
+			fprintf(stderr, "%s: missing \"%s\"\n", t->name, t->present[i]);
+			ok = FALSE;
+		}
+		if (t->absent[i] != NULL && strstr(listing, t->absent[i]) != NULL) {
+			fprintf(stderr, "%s: unexpected \"%s\"\n", t->name, t->absent[i]);
+			ok = FALSE;
+		}
+	}
+	if (!ok) {
+		fprintf(stderr, "%s", listing);
+	}
+	free(listing);
+
+	if ((jar = getenv("JASMIN_JAR")) != NULL) {
+		assemble(jar);
+		snprintf(path, sizeof(path), "java -cp . %s > %s.out", t->name,
+		         t->name);
+		if (system(path) != 0) {
+			fprintf(stderr, "%s: the class did not run\n", t->name);
+			ok = FALSE;
+		} else {
+			snprintf(path, sizeof(path), "%s.out", t->name);
+			output = read_file(path);
+			if (strcmp(output, t->output) != 0) {
+				fprintf(stderr, "%s: printed \"%s\", not \"%s\"\n", t->name,
+				        output, t->output);
+				ok = FALSE;
+			}
+			free(output);
+		}
+	}
+
+	release_symbol_table();
+	release_code_generation();
+
+	return ok;
+}
+
+/**
+ * Returns the contents of the specified file as a newly allocated string.
+ *
+ * @param[in] path the path of the file.
+ * @return         the contents of the file.
+ */
+static char *read_file(const char *path)
+{
+	char *text;
+	long size;
+	FILE *file;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		eprintf("Could not open %s:", path);
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	text = emalloc(size + 1);
+	text[fread(text, 1, size, file)] = '\0';
+	fclose(file);
+
+	return text;
+}
+
+/* --- program building blocks ----------------------------------------------*/
+
+/**
+ * Declares a variable in the current scope, the way the parser does.
+ *
+ * @param[in] id   the name of the variable.
+ * @param[in] type the type of the variable.
+ * @return         the properties of the variable, with its slot.
+ */
+static IDPropt *declare(char *id, ValType type)
+{
+	IDPropt *p;
+
+	p = emalloc(sizeof(IDPropt));
+	p->type = type;
+	p->offset = 0;
+	p->nparams = 0;
+	p->params = NULL;
+	if (!insert_name(estrdup(id), p)) {
+		eprintf("Could not declare '%s'", id);
+	}
+
+	return p;
+}
+
+/**
+ * Opens a subroutine with integer parameters, the way the parser does, and
+ * starts its code.  The parameters must be declared next, in order.
+ *
+ * @param[in] id      the name of the subroutine.
+ * @param[in] type    the return type, or <code>TYPE_NONE</code>.
+ * @param[in] nparams the number of parameters.
+ * @return            the properties of the subroutine.
+ */
+static IDPropt *open_sub(char *id, ValType type, unsigned int nparams)
+{
+	IDPropt *p;
+	unsigned int k;
+
+	p = emalloc(sizeof(IDPropt));
+	p->type = TYPE_CALLABLE | type;
+	p->offset = 0;
+	p->nparams = nparams;
+	p->params = emalloc((nparams + 1) * sizeof(ValType));
+	for (k = 0; k < nparams; k++) {
+		p->params[k] = TYPE_INTEGER;
+	}
+	if (!open_subroutine(estrdup(id), p)) {
+		eprintf("Could not open subroutine '%s'", id);
+	}
+	init_subroutine_codegen(id, p);
+
+	return p;
+}
+
+/**
+ * Ends the code of the current subroutine, and closes its scope.
+ */
+static void close_sub(void)
+{
+	close_subroutine_codegen(get_variables_width());
+	close_subroutine();
+}
+
+/* --- the programs ---------------------------------------------------------*/
+
+/**
+ * Generates <code>main: if true: output(1) end</code>, whose guard must
+ * disappear.
+ */
+static void gen_true_guard(void)
+{
+	Label l;
+
+	init_subroutine_codegen("main", NULL);
+	l = get_label();
+	gen_2(JVM_LDC, TRUE);
+	gen_2_label(JVM_IFEQ, l);
+	gen_print_begin();
+	gen_2(JVM_LDC, 1);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_label(l);
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates <code>main: if false: output(7) end; output(2)</code>, whose
+ * guard must become a jump over code that is then unreachable.
+ */
+static void gen_false_guard(void)
+{
+	Label l;
+
+	init_subroutine_codegen("main", NULL);
+	l = get_label();
+	gen_2(JVM_LDC, FALSE);
+	gen_2_label(JVM_IFEQ, l);
+	gen_print_begin();
+	gen_2(JVM_LDC, 7);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_label(l);
+	gen_print_begin();
+	gen_2(JVM_LDC, 2);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     main:
+ *         int i;
+ *         let i = 0;
+ *         while i < 3: output(i); let i = i + 1 end
+ *
+ * whose loop test must become a single negated comparison.
+ */
+static void gen_fused_compare(void)
+{
+	IDPropt *i;
+	Label top, end;
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	top = get_label();
+	end = get_label();
+	gen_2(JVM_LDC, 0);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_label(top);
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 3);
+	gen_cmp(JVM_IF_ICMPLT);
+	gen_2_label(JVM_IFEQ, end);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_IADD);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_2_label(JVM_GOTO, top);
+	gen_label(end);
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     main:
+ *         int x;
+ *         let x = 2;
+ *         if x = 1: output(10)
+ *         elif x = 2: output(20)
+ *         elif x = 3: output(30)
+ *         end
+ *
+ * whose guards must become a single switch.
+ */
+static void gen_if_chain(void)
+{
+	IDPropt *x;
+	Label end, next;
+	int key;
+
+	init_subroutine_codegen("main", NULL);
+	x = declare("x", TYPE_INTEGER);
+	gen_2(JVM_LDC, 2);
+	gen_2(JVM_ISTORE, x->offset);
+	end = get_label();
+	next = get_label();
+	for (key = 1; key <= 3; key++) {
+		if (key > 1) {
+			gen_label(next);
+			next = get_label();
+		}
+		gen_2(JVM_ILOAD, x->offset);
+		gen_2(JVM_LDC, key);
+		gen_cmp(JVM_IF_ICMPEQ);
+		gen_2_label(JVM_IFEQ, next);
+		gen_print_begin();
+		gen_2(JVM_LDC, 10 * key);
+		gen_print(TYPE_INTEGER);
+		gen_print_end();
+		gen_2_label(JVM_GOTO, end);
+	}
+	gen_label(next);
+	gen_label(end);
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     sum(int n) -> int:
+ *         if n = 0: return 0 end;
+ *         return n + sum(n - 1)
+ *     diff(int a, int b) -> int:
+ *         int d;
+ *         let d = a - b;
+ *         return d
+ *     main:
+ *         int i;
+ *         let i = 4;
+ *         output(sum(i) .. " " .. diff(i, 1))
+ *
+ * whose parameters must be read from the slots, from 0, that the JVM passes
+ * them in, and whose local d must not share a slot with a parameter.
+ */
+static void gen_param_slots(void)
+{
+	char sum[] = "sum", diff[] = "diff";
+	IDPropt *psum, *pdiff, *n, *a, *b, *d, *i;
+	Label l;
+
+	/* the calls must stay calls, so that the callees keep their code */
+	set_inline_budget(0);
+
+	psum = open_sub(sum, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	l = get_label();
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 0);
+	gen_cmp(JVM_IF_ICMPEQ);
+	gen_2_label(JVM_IFEQ, l);
+	gen_2(JVM_LDC, 0);
+	gen_1(JVM_IRETURN);
+	gen_label(l);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_ISUB);
+	gen_call(sum, psum);
+	gen_1(JVM_IADD);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	pdiff = open_sub(diff, TYPE_INTEGER, 2);
+	a = declare("a", TYPE_INTEGER);
+	b = declare("b", TYPE_INTEGER);
+	d = declare("d", TYPE_INTEGER);
+	gen_2(JVM_ILOAD, a->offset);
+	gen_2(JVM_ILOAD, b->offset);
+	gen_1(JVM_ISUB);
+	gen_2(JVM_ISTORE, d->offset);
+	gen_2(JVM_ILOAD, d->offset);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	gen_2(JVM_LDC, 4);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_call(sum, psum);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(" "));
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 1);
+	gen_call(diff, pdiff);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     max(int a, int b) -> int:
+ *         if a > b: return a end;
+ *         return b
+ *     main:
+ *         int i;
+ *         let i = 0;
+ *         while i <= 7: output(max(i, 7 - i) .. " "); let i = i + 1 end
+ *
+ * whose call must be inlined, with the arguments stored in the slots that
+ * the copy of the body reads its parameters from.
+ */
+static void gen_inline_max(void)
+{
+	char max[] = "max";
+	IDPropt *pmax, *a, *b, *i;
+	Label l, top, end;
+
+	pmax = open_sub(max, TYPE_INTEGER, 2);
+	a = declare("a", TYPE_INTEGER);
+	b = declare("b", TYPE_INTEGER);
+	l = get_label();
+	gen_2(JVM_ILOAD, a->offset);
+	gen_2(JVM_ILOAD, b->offset);
+	gen_cmp(JVM_IF_ICMPGT);
+	gen_2_label(JVM_IFEQ, l);
+	gen_2(JVM_ILOAD, a->offset);
+	gen_1(JVM_IRETURN);
+	gen_label(l);
+	gen_2(JVM_ILOAD, b->offset);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	top = get_label();
+	end = get_label();
+	gen_2(JVM_LDC, 0);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_label(top);
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 7);
+	gen_cmp(JVM_IF_ICMPLE);
+	gen_2_label(JVM_IFEQ, end);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 7);
+	gen_2(JVM_ILOAD, i->offset);
+	gen_1(JVM_ISUB);
+	gen_call(max, pmax);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(" "));
+	gen_print_end();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_IADD);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_2_label(JVM_GOTO, top);
+	gen_label(end);
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     twice(int n) -> int: return n + n
+ *     quad(int n) -> int: return twice(twice(n))
+ *     main: int i; let i = 3; output(quad(i))
+ *
+ * in which twice is inlined into quad, and quad into main, so that the
+ * parameters of the copies live in slots above those of the caller.
+ */
+static void gen_inline_nested(void)
+{
+	char twice[] = "twice", quad[] = "quad";
+	IDPropt *ptwice, *pquad, *n, *i;
+
+	ptwice = open_sub(twice, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_1(JVM_IADD);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	pquad = open_sub(quad, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_call(twice, ptwice);
+	gen_call(twice, ptwice);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	gen_2(JVM_LDC, 3);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_call(quad, pquad);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     gcd(int a, int b) -> int:
+ *         if b = 0: return a end;
+ *         return gcd(b, a rem b)
+ *     main:
+ *         int i;
+ *         let i = 1;
+ *         while i <= 4:
+ *             output(gcd(i * 1071, i * 462) .. " ");
+ *             let i = i + 1
+ *         end
+ *
+ * whose self-call must become stores into the parameters and a jump.
+ */
+static void gen_tail_call(void)
+{
+	char gcd[] = "gcd";
+	IDPropt *pgcd, *a, *b, *i;
+	Label l, top, end;
+
+	/* main must call gcd, rather than a copy of it */
+	set_inline_budget(0);
+
+	pgcd = open_sub(gcd, TYPE_INTEGER, 2);
+	a = declare("a", TYPE_INTEGER);
+	b = declare("b", TYPE_INTEGER);
+	l = get_label();
+	gen_2(JVM_ILOAD, b->offset);
+	gen_2(JVM_LDC, 0);
+	gen_cmp(JVM_IF_ICMPEQ);
+	gen_2_label(JVM_IFEQ, l);
+	gen_2(JVM_ILOAD, a->offset);
+	gen_1(JVM_IRETURN);
+	gen_label(l);
+	gen_2(JVM_ILOAD, b->offset);
+	gen_2(JVM_ILOAD, a->offset);
+	gen_2(JVM_ILOAD, b->offset);
+	gen_1(JVM_IREM);
+	gen_call(gcd, pgcd);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	top = get_label();
+	end = get_label();
+	gen_2(JVM_LDC, 1);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_label(top);
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 4);
+	gen_cmp(JVM_IF_ICMPLE);
+	gen_2_label(JVM_IFEQ, end);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 1071);
+	gen_1(JVM_IMUL);
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 462);
+	gen_1(JVM_IMUL);
+	gen_call(gcd, pgcd);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(" "));
+	gen_print_end();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_IADD);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_2_label(JVM_GOTO, top);
+	gen_label(end);
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     pow2(int n) -> int:
+ *         int r;
+ *         let r = 1;
+ *         while n > 0: let r = r * 2; let n = n - 1 end;
+ *         return r
+ *     main:
+ *         int i;
+ *         let i = 16;
+ *         output(pow2(16) .. " " .. pow2(i))
+ *
+ * whose first call must be evaluated at compile time, to the value that the
+ * second computes at run time.
+ */
+static void gen_evaluate_call(void)
+{
+	char pow2[] = "pow2";
+	IDPropt *ppow2, *n, *r, *i;
+	Label top, end;
+
+	/* the second call must stay a call */
+	set_inline_budget(0);
+
+	ppow2 = open_sub(pow2, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	r = declare("r", TYPE_INTEGER);
+	top = get_label();
+	end = get_label();
+	gen_2(JVM_LDC, 1);
+	gen_2(JVM_ISTORE, r->offset);
+	gen_label(top);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 0);
+	gen_cmp(JVM_IF_ICMPGT);
+	gen_2_label(JVM_IFEQ, end);
+	gen_2(JVM_ILOAD, r->offset);
+	gen_2(JVM_LDC, 2);
+	gen_1(JVM_IMUL);
+	gen_2(JVM_ISTORE, r->offset);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_ISUB);
+	gen_2(JVM_ISTORE, n->offset);
+	gen_2_label(JVM_GOTO, top);
+	gen_label(end);
+	gen_2(JVM_ILOAD, r->offset);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	gen_2(JVM_LDC, 16);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_print_begin();
+	gen_2(JVM_LDC, 16);
+	gen_call(pow2, ppow2);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(" "));
+	gen_2(JVM_ILOAD, i->offset);
+	gen_call(pow2, ppow2);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     tell(int n) -> int:
+ *         output("<" .. n .. ">");
+ *         return n
+ *     main:
+ *         output("a" .. tell(1) .. "b" .. tell(2) .. "c")
+ *
+ * whose output must show what each call prints after the text before it.
+ */
+static void gen_print_order(void)
+{
+	char tell[] = "tell";
+	IDPropt *ptell, *n;
+
+	/* the calls must stay calls */
+	set_inline_budget(0);
+
+	ptell = open_sub(tell, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	gen_print_begin();
+	gen_print_string(estrdup("<"));
+	gen_2(JVM_ILOAD, n->offset);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(">"));
+	gen_print_end();
+	gen_2(JVM_ILOAD, n->offset);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	gen_print_begin();
+	gen_print_string(estrdup("a"));
+	gen_2(JVM_LDC, 1);
+	gen_call(tell, ptell);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup("b"));
+	gen_2(JVM_LDC, 2);
+	gen_call(tell, ptell);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup("c"));
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates
+ *
+ *     fib(int n) -> int:
+ *         if n < 2: return n end;
+ *         return fib(n - 1) + fib(n - 2)
+ *     main:
+ *         int i;
+ *         let i = 20;
+ *         output(fib(i))
+ *
+ * with fib memoised, and its methods written by several threads.
+ */
+static void gen_memo_threads(void)
+{
+	char fib[] = "fib";
+	IDPropt *pfib, *n, *i;
+	Label l;
+
+	set_dump_threads(4);
+
+	pfib = open_sub(fib, TYPE_INTEGER, 1);
+	n = declare("n", TYPE_INTEGER);
+	l = get_label();
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 2);
+	gen_cmp(JVM_IF_ICMPLT);
+	gen_2_label(JVM_IFEQ, l);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_1(JVM_IRETURN);
+	gen_label(l);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_ISUB);
+	gen_call(fib, pfib);
+	gen_2(JVM_ILOAD, n->offset);
+	gen_2(JVM_LDC, 2);
+	gen_1(JVM_ISUB);
+	gen_call(fib, pfib);
+	gen_1(JVM_IADD);
+	gen_1(JVM_IRETURN);
+	close_sub();
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	gen_2(JVM_LDC, 20);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_print_begin();
+	gen_2(JVM_ILOAD, i->offset);
+	gen_call(fib, pfib);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates <code>main: int i; let i = 5; output("n\xc3\xa9 " .. i)</code>,
+ * with text outside ASCII, for the buffered output runtime.
+ */
+static void gen_fast_text(void)
+{
+	IDPropt *i;
+
+	init_subroutine_codegen("main", NULL);
+	i = declare("i", TYPE_INTEGER);
+	gen_2(JVM_LDC, 5);
+	gen_2(JVM_ISTORE, i->offset);
+	gen_print_begin();
+	gen_print_string(estrdup("n\xc3\xa9 "));
+	gen_2(JVM_ILOAD, i->offset);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
+
+/**
+ * Generates <code>main: int x; let x = 5; output(3 * x .. " " .. 4 * x)</code>,
+ * in which only the second multiplication, by a power of two, may change.
+ */
+static void gen_constant_first(void)
+{
+	IDPropt *x;
+
+	init_subroutine_codegen("main", NULL);
+	x = declare("x", TYPE_INTEGER);
+	gen_2(JVM_LDC, 5);
+	gen_2(JVM_ISTORE, x->offset);
+	gen_print_begin();
+	gen_2(JVM_LDC, 3);
+	gen_2(JVM_ILOAD, x->offset);
+	gen_1(JVM_IMUL);
+	gen_print(TYPE_INTEGER);
+	gen_print_string(estrdup(" "));
+	gen_2(JVM_LDC, 4);
+	gen_2(JVM_ILOAD, x->offset);
+	gen_1(JVM_IMUL);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+}
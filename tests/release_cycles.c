@@ -0,0 +1,194 @@
+/**
+ * @file    release_cycles.c
+ * @brief   Regression test: compile 10,000 programs in one process through
+ *          the symbol table and the code generator, and check that the
+ *          resident set size stays flat across the cycles.  The parser and
+ *          the rest of amplc are not exercised.
+ */
+
+#include "codegen.h"
+
+#include "boolean.h"
+#include "error.h"
+#include "symboltable.h"
+#include "valtypes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#define NPROGRAMS  10000
+#define WARMUP     1000
+#define MAX_GROWTH 1024 /* kilobytes of RSS growth allowed after the warmup */
+#define NOPTIONS   64   /* every combination of the code generation options */
+
+/* The quarantine of ASan holds on to freed memory, so that the RSS grows even
+ * without leaks; under ASan, LeakSanitizer checks for leaks at exit instead.
+ */
+#if defined(__SANITIZE_ADDRESS__)
+#define CHECK_RSS 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CHECK_RSS 0
+#endif
+#endif
+#ifndef CHECK_RSS
+#define CHECK_RSS 1
+#endif
+
+static IDPropt *idprop(ValType type, unsigned int nparams, ValType *params);
+static void compile_program(int n);
+static long max_rss(void);
+
+int main(int argc, char *argv[])
+{
+	int i;
+	long rss;
+
+	(void) argc;
+
+	rss = 0;
+	for (i = 0; i < NPROGRAMS; i++) {
+		if (i == WARMUP) {
+			rss = max_rss();
+		}
+		compile_program(i);
+	}
+
+	if (CHECK_RSS && max_rss() - rss > MAX_GROWTH) {
+		fprintf(stderr, "%s: RSS grew from %ld to %ld kB over %d programs\n",
+		        argv[0], rss, max_rss(), NPROGRAMS - WARMUP);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Returns newly allocated identifier properties, the way the parser builds
+ * them.
+ *
+ * @param[in] type    the type of the identifier.
+ * @param[in] nparams the number of parameters of a subroutine.
+ * @param[in] params  the parameter types, or <code>NULL</code>.
+ * @return            the identifier properties.
+ */
+static IDPropt *idprop(ValType type, unsigned int nparams, ValType *params)
+{
+	IDPropt *p;
+
+	p = emalloc(sizeof(IDPropt));
+	p->type = type;
+	p->offset = 0;
+	p->nparams = nparams;
+	p->params = params;
+
+	return p;
+}
+
+/**
+ * Compiles the program
+ *
+ *     program Cycle:
+ *     sum(int n) -> int:
+ *         int s;
+ *         s := 0;
+ *         while n > 0: s := s + n; n := n - 1 end;
+ *         return s
+ *     main:
+ *         int a; int[] b;
+ *         a := sum(n % 100);
+ *         b := array 10; b[1] := a;
+ *         output "sum: " .. a
+ *
+ * with the n-th combination of code generation options, and releases it.
+ *
+ * @param[in] n the number of the program.
+ */
+static void compile_program(int n)
+{
+	char class_name[] = "Cycle", sum[] = "sum";
+	ValType *params;
+	IDPropt *sub, *p, *s, *a, *b;
+	Label top, end;
+
+	init_symbol_table();
+	init_code_generation();
+	set_codegen_options((unsigned int) n % NOPTIONS);
+	set_class_name(class_name);
+
+	params = emalloc(sizeof(ValType));
+	params[0] = TYPE_INTEGER;
+	sub = idprop(TYPE_CALLABLE | TYPE_INTEGER, 1, params);
+	if (!open_subroutine(estrdup(sum), sub)) {
+		eprintf("Could not open subroutine");
+	}
+	insert_name(estrdup("n"), p = idprop(TYPE_INTEGER, 0, NULL));
+	insert_name(estrdup("s"), s = idprop(TYPE_INTEGER, 0, NULL));
+
+	init_subroutine_codegen(sum, sub);
+	top = get_label();
+	end = get_label();
+	gen_2(JVM_LDC, 0);
+	gen_2(JVM_ISTORE, s->offset);
+	gen_label(top);
+	gen_2(JVM_ILOAD, p->offset);
+	gen_2(JVM_LDC, 0);
+	gen_cmp(JVM_IF_ICMPGT);
+	gen_2_label(JVM_IFEQ, end);
+	gen_2(JVM_ILOAD, s->offset);
+	gen_2(JVM_ILOAD, p->offset);
+	gen_1(JVM_IADD);
+	gen_2(JVM_ISTORE, s->offset);
+	gen_2(JVM_ILOAD, p->offset);
+	gen_2(JVM_LDC, 1);
+	gen_1(JVM_ISUB);
+	gen_2(JVM_ISTORE, p->offset);
+	gen_2_label(JVM_GOTO, top);
+	gen_label(end);
+	gen_2(JVM_ILOAD, s->offset);
+	gen_1(JVM_IRETURN);
+	close_subroutine_codegen(get_variables_width());
+	close_subroutine();
+
+	insert_name(estrdup("a"), a = idprop(TYPE_INTEGER, 0, NULL));
+	insert_name(estrdup("b"), b = idprop(TYPE_INTEGER | TYPE_ARRAY, 0, NULL));
+	init_subroutine_codegen("main", NULL);
+	gen_2(JVM_LDC, n % 100);
+	gen_call(sum, sub);
+	gen_2(JVM_ISTORE, a->offset);
+	gen_2(JVM_LDC, 10);
+	gen_newarray(T_INT);
+	gen_2(JVM_ASTORE, b->offset);
+	gen_2(JVM_ALOAD, b->offset);
+	gen_2(JVM_LDC, 1);
+	gen_2(JVM_ILOAD, a->offset);
+	gen_1(JVM_IASTORE);
+	gen_print_begin();
+	gen_print_string(estrdup("sum: "));
+	gen_2(JVM_ILOAD, a->offset);
+	gen_print(TYPE_INTEGER);
+	gen_print_end();
+	gen_1(JVM_RETURN);
+	close_subroutine_codegen(get_variables_width());
+
+	make_code_file();
+	release_symbol_table();
+	release_code_generation();
+}
+
+/**
+ * Returns the peak resident set size of the process so far.
+ *
+ * @return the peak resident set size, in kilobytes.
+ */
+static long max_rss(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		eprintf("Could not measure the resident set size:");
+	}
+
+	return usage.ru_maxrss;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Builds each test driver in this directory against the compiler units in the
+# tree, with support.c standing in for the error and value-type routines, and
+# runs it in a scratch directory.  A driver passes if it exits with status 0.
+# If JASMIN_JAR names the Jasmin jar, codegen_tests also assembles and runs
+# the classes it generates.
+#
+# usage: tests/run_tests.sh [test ...]
+#
+# CC and CFLAGS are taken from the environment; for example, run the tests
+# under ASan/LSan with CFLAGS="-g -fsanitize=address,undefined".
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-O2 -g"}
+TESTS=$(cd "$(dirname "$0")" && pwd)
+SRC=$(dirname "$TESTS")
+UNITS="$SRC/codegen.c $SRC/symboltable.c $SRC/hashtable.c $TESTS/support.c"
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+if [ $# -eq 0 ]; then
+	set -- codegen_tests release_cycles
+fi
+
+failed=0
+for t in "$@"; do
+	if ! $CC $CFLAGS -I"$SRC" -o "$WORK/$t" "$TESTS/$t.c" $UNITS \
+	     -lpthread; then
+		echo "FAIL $t (build)"
+		failed=$((failed + 1))
+	elif (cd "$WORK" && "./$t"); then
+		echo "PASS $t"
+	else
+		echo "FAIL $t"
+		failed=$((failed + 1))
+	fi
+done
+
+[ $failed -eq 0 ]
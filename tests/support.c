@@ -0,0 +1,92 @@
+/**
+ * @file    support.c
+ * @brief   Stand-ins for the error-handling and value-type routines that the
+ *          compiler units call, so that the test drivers link against the
+ *          units in this tree alone.  Any error ends the test.
+ */
+
+#include "error.h"
+#include "valtypes.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void eprintf(const char *fmt, ...)
+{
+	va_list args;
+	int errnum;
+
+	errnum = errno;
+	fflush(stdout);
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+
+	/* a message that ends in a colon is followed by the system error */
+	if (fmt[0] != '\0' && fmt[strlen(fmt) - 1] == ':') {
+		fprintf(stderr, " %s", strerror(errnum));
+	}
+	fprintf(stderr, "\n");
+
+	exit(EXIT_FAILURE);
+}
+
+void weprintf(const char *fmt, ...)
+{
+	va_list args;
+
+	fflush(stdout);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+}
+
+void *emalloc(size_t n)
+{
+	void *p;
+
+	if ((p = malloc(n)) == NULL) {
+		eprintf("Could not allocate %zu bytes:", n);
+	}
+
+	return p;
+}
+
+void *erealloc(void *p, size_t n)
+{
+	if ((p = realloc(p, n)) == NULL) {
+		eprintf("Could not reallocate %zu bytes:", n);
+	}
+
+	return p;
+}
+
+char *estrdup(const char *s)
+{
+	char *t;
+
+	t = emalloc(strlen(s) + 1);
+	strcpy(t, s);
+
+	return t;
+}
+
+const char *get_valtype_string(ValType type)
+{
+	if (IS_CALLABLE_TYPE(type)) {
+		return "callable";
+	} else if (IS_ARRAY_TYPE(type)) {
+		return IS_BOOLEAN_TYPE(type) ? "boolean array" : "integer array";
+	} else if (IS_BOOLEAN_TYPE(type)) {
+		return "boolean";
+	} else if (IS_INTEGER_TYPE(type)) {
+		return "integer";
+	}
+
+	return "none";
+}